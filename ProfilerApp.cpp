@@ -1,10 +1,13 @@
 #include "ProfilerApp.h"
 #include "MemoryApp.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <condition_variable>
 #include <cstdio>
 #include <ctime>
+#include <exception>
 #include <iostream>
 #include <map>
 #include <mutex>
@@ -12,6 +15,29 @@
 #include <thread>
 #include <vector>
 
+#ifdef TIMER_ENABLE_TSC
+#include <cpuid.h>
+#endif
+
+#if defined( __linux__ ) && __has_include( <linux/perf_event.h> )
+#define TIMER_ENABLE_PERF
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined( __linux__ )
+#include <pthread.h>
+#endif
+
+#if defined( __unix__ ) || defined( __APPLE__ )
+#define TIMER_ENABLE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 
 #ifdef USE_MPI
 PROFILE_DISABLE_WARNINGS
@@ -72,21 +98,6 @@ static bool approx_equal( double x, double y, double tol = 1e-12 )
 }
 
 
-// Get the time elapsed in ns
-// Note we implement this because duration_cast takes too long in debug
-static inline int64_t diff_ns(
-    const ProfilerApp::time_point& t2, const ProfilerApp::time_point& t1 )
-{
-    using PERIOD = typename ProfilerApp::time_point::period;
-    if constexpr ( std::ratio_equal_v<PERIOD, std::nano> &&
-                   sizeof( ProfilerApp::time_point ) == 8 ) {
-        return *reinterpret_cast<const int64_t*>( &t2 ) - *reinterpret_cast<const int64_t*>( &t1 );
-    } else {
-        return std::chrono::duration_cast<std::chrono::nanoseconds>( t2 - t1 ).count();
-    }
-}
-
-
 // Wrappers for malloc/realloc
 template<class T>
 T* allocate( size_t N )
@@ -112,17 +123,36 @@ void resize( T*& ptr, size_t N )
  * Define global variables                                         *
  ******************************************************************/
 static std::mutex d_lock;
-static ProfilerApp::time_point d_construct_time = std::chrono::steady_clock::now();
+static std::atomic_int d_times_readers( 0 ); // Threads copying the trace times (see newBlock)
 static ProfilerApp::ThreadData d_threadData;
 constexpr size_t ProfilerApp::StoreTimes::MAX_TRACE;
+constexpr size_t ProfilerApp::StoreTimes::MAX_BYTES;
+constexpr size_t ProfilerApp::StoreTimes::BLOCK_BYTES;
 constexpr size_t ProfilerApp::StoreMemory::MAX_ENTRIES;
+constexpr size_t ProfilerApp::StoreMemory::BLOCK_ENTRIES;
 constexpr uint64_t ProfilerApp::HASH_SIZE;
 static_assert( ProfilerApp::HASH_SIZE == ( (uint64_t) 0x1 << log2int( ProfilerApp::HASH_SIZE ) ) );
 bool ProfilerApp::d_store_trace_data                      = false;
+size_t ProfilerApp::d_trace_size                          = 0;
+uint64_t ProfilerApp::d_trace_window                      = 0;
+uint64_t ProfilerApp::d_trace_min                         = 0;
+uint64_t ProfilerApp::d_trace_gap                         = 0;
+bool ProfilerApp::d_store_cpu                             = false;
+bool ProfilerApp::d_store_hist                            = false;
+bool ProfilerApp::d_store_slow                            = false;
+bool ProfilerApp::d_save_binary                           = false;
+int ProfilerApp::d_load_threads                           = 0;
+ProfilerApp::CounterSet ProfilerApp::d_counters           = ProfilerApp::CounterSet::None;
 ProfilerApp::MemoryLevel ProfilerApp::d_store_memory_data = MemoryLevel::None;
 bool ProfilerApp::d_disable_timer_error                   = false;
 int8_t ProfilerApp::d_level                               = -1;
 uint64_t ProfilerApp::d_shift                             = 0;
+ProfilerApp::ClockSource ProfilerApp::d_clock             = ProfilerApp::ClockSource::Steady;
+ProfilerApp::time_point ProfilerApp::d_construct_time     = std::chrono::steady_clock::now();
+uint64_t ProfilerApp::d_tsc_start                         = 0;
+uint64_t ProfilerApp::d_tsc_scale                         = 0;
+float ProfilerApp::d_overhead                             = 0;
+float ProfilerApp::d_budget                               = 0;
 volatile std::atomic_int64_t ProfilerApp::d_bytes         = 0;
 
 
@@ -263,95 +293,263 @@ static inline std::vector<uint64_t> comm_recv2( int, int )
 
 /***********************************************************************
  * StoreTimes                                                           *
+ * Note: Each call is stored as the time from the previous stop to the  *
+ *   start and the time from the start to the stop, encoded as unsigned *
+ *   LEB128 integers (7 bits per byte, the high bit is set if more      *
+ *   bytes follow).  The times are exact and most calls need 2-5 bytes. *
  ***********************************************************************/
-ProfilerApp::StoreTimes::StoreTimes()
-    : d_capacity( 0 ), d_size( 0 ), d_offset( 0 ), d_data( nullptr )
+static inline size_t encodeLEB128( uint64_t x, uint8_t* data )
 {
+    size_t i = 0;
+    while ( x >= 0x80 ) {
+        data[i++] = static_cast<uint8_t>( x | 0x80 );
+        x >>= 7;
+    }
+    data[i++] = static_cast<uint8_t>( x );
+    return i;
 }
-ProfilerApp::StoreTimes::StoreTimes( const StoreTimes& rhs, uint64_t shift )
-    : d_capacity( 0 ), d_size( 0 ), d_offset( 0 ), d_data( nullptr )
+template<class NEXT>
+static inline uint64_t decodeLEB128( NEXT next )
 {
-    constexpr uint64_t max_diff = std::numeric_limits<uint16f>::max();
-    uint64_t start2             = rhs.d_data[0] + shift;
-    if ( start2 < max_diff && start2 < 20000 * ( rhs.d_data[1] - rhs.d_data[0] + 1 ) ) {
-        reserve( rhs.d_size );
-        memcpy( d_data, rhs.d_data, 2 * rhs.d_size * sizeof( uint16f ) );
-        d_data[0] = uint16f( start2 );
-        d_size    = rhs.d_size;
-        d_offset  = rhs.d_offset + shift;
-    } else {
-        add( shift, shift );
-        reserve( d_size + rhs.d_size );
-        memcpy( &d_data[2 * d_size], rhs.d_data, 2 * rhs.d_size * sizeof( uint16f ) );
-        d_size   = d_size + rhs.d_size;
-        d_offset = rhs.d_offset + shift;
+    uint64_t x = 0;
+    for ( int shift = 0; shift < 64; shift += 7 ) {
+        uint8_t byte = next();
+        x |= static_cast<uint64_t>( byte & 0x7F ) << shift;
+        if ( ( byte & 0x80 ) == 0 )
+            break;
     }
+    return x;
 }
-ProfilerApp::StoreTimes::~StoreTimes() { free( d_data ); }
-inline void ProfilerApp::StoreTimes::reserve( size_t N )
+static inline uint64_t decodeLEB128( const uint8_t* data, size_t& i )
 {
-    d_capacity = N;
-    resize( d_data, 2 * d_capacity );
+    return decodeLEB128( [data, &i] { return data[i++]; } );
 }
-inline void ProfilerApp::StoreTimes::add( uint64_t start, uint64_t stop )
+static inline size_t sizeLEB128( const uint8_t* data, size_t N )
 {
-    // Allocate more memory if needed
-    if ( d_size >= d_capacity ) {
-        if ( d_size >= MAX_TRACE )
-            return;
-        size_t N = std::max<size_t>( 2 * d_capacity, 1024 );
-        N        = std::min<size_t>( N, MAX_TRACE );
-        reserve( N );
-    }
-    constexpr uint64_t max_diff = std::numeric_limits<uint16f>::max();
-    uint64_t diff               = start - d_offset;
-    uint16f tmp( diff );
-    if ( stop - start > max_diff ) {
-        // We are trying to store an interval that is too large, break it up
-        add( start, start + max_diff );
-        add( start + max_diff, stop );
-    } else if ( diff > max_diff ) {
-        // The interval to start is too large, break it up
-        add( max_diff, max_diff );
-        add( start, stop );
-    } else if ( ( diff - tmp ) > ( stop - start + 1 ) ) {
-        // We are loosing resolution
-        d_data[2 * d_size + 0] = tmp;
-        d_data[2 * d_size + 1] = uint16f( 0 );
-        d_offset += d_data[2 * d_size + 0];
-        d_size++;
-        add( start, stop );
-    } else {
-        // Store the data
-        d_data[2 * d_size + 0] = tmp;
-        d_offset += d_data[2 * d_size + 0];
-        d_data[2 * d_size + 1] = uint16f( stop - d_offset );
-        d_offset += d_data[2 * d_size + 1];
-        d_size++;
+    size_t i = 0;
+    for ( size_t j = 0; j < N; i++ ) {
+        if ( ( data[i] & 0x80 ) == 0 )
+            j++;
     }
+    return i;
 }
-uint16f* ProfilerApp::StoreTimes::take()
+ProfilerApp::StoreTimes::StoreTimes( Arena* arena )
+    : d_arena( arena ),
+      d_first( nullptr ),
+      d_last( nullptr ),
+      d_free( nullptr ),
+      d_head( 0 ),
+      d_tail( 0 ),
+      d_size( 0 ),
+      d_length( 0 ),
+      d_base( 0 ),
+      d_offset( 0 )
 {
-    auto ptr   = d_data;
-    d_data     = nullptr;
-    d_size     = 0;
-    d_capacity = 0;
-    d_offset   = 0;
+}
+ProfilerApp::StoreTimes::~StoreTimes() { clear(); }
+void ProfilerApp::StoreTimes::clear()
+{
+    // Blocks allocated from the arena are released with the arena
+    if ( !d_arena ) {
+        auto block = d_free ? d_free : d_first;
+        while ( block ) {
+            auto next = block->next;
+            free( block );
+            block = next;
+        }
+    }
+    d_first  = nullptr;
+    d_last   = nullptr;
+    d_free   = nullptr;
+    d_head   = 0;
+    d_tail   = 0;
+    d_size   = 0;
+    d_length = 0;
+    d_base   = 0;
+    d_offset = 0;
+}
+inline ProfilerApp::StoreTimes::Block* ProfilerApp::StoreTimes::newBlock()
+{
+    // Reuse the oldest removed block unless another thread may be copying it
+    Block* block = d_free;
+    if ( block ) {
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        if ( d_times_readers.load( std::memory_order_relaxed ) != 0 )
+            block = nullptr;
+    }
+    if ( block )
+        d_free = block->next != d_first ? block->next : nullptr;
+    else if ( d_arena )
+        block = reinterpret_cast<Block*>( d_arena->allocate( sizeof( Block ) ) );
+    else
+        block = allocate<Block>( 1 );
+    block->next = nullptr;
+    return block;
+}
+inline void ProfilerApp::StoreTimes::read(
+    const Block*& block, size_t& i, uint64_t& start, uint64_t& dt )
+{
+    // The entry may continue in the next block
+    auto next = [&block, &i] {
+        if ( i == BLOCK_BYTES ) {
+            block = block->next;
+            i     = 0;
+        }
+        return block->data[i++];
+    };
+    start = decodeLEB128( next );
+    dt    = decodeLEB128( next );
+}
+inline void ProfilerApp::StoreTimes::pop()
+{
+    uint64_t start = 0, dt = 0;
+    const Block* block = d_first;
+    size_t i           = d_head;
+    read( block, i, start, dt );
+    size_t n = block == d_first ? i - d_head : BLOCK_BYTES - d_head + i;
+    if ( block != d_first ) {
+        // Recycle the block (the removed blocks stay linked so a copy can still read them)
+        if ( !d_free )
+            d_free = d_first;
+        d_first = d_first->next;
+    }
+    d_base += start + dt;
+    d_head = i;
+    d_length -= n;
+    d_size--;
+}
+inline void ProfilerApp::StoreTimes::add(
+    uint64_t start, uint64_t stop, size_t ring, uint64_t window )
+{
+    // Remove the oldest entries from the ring buffer
+    size_t max_size = ring > 0 ? std::min( ring, MAX_TRACE ) : MAX_TRACE;
+    if ( ring > 0 || window > 0 ) {
+        uint64_t start0 = 0, dt0 = 0;
+        while ( window > 0 && d_size > 0 ) {
+            const Block* block = d_first;
+            size_t i           = d_head;
+            read( block, i, start0, dt0 );
+            if ( d_base + start0 + dt0 + window >= start )
+                break;
+            pop();
+        }
+        while ( d_size >= max_size )
+            pop();
+    }
+    if ( d_size >= max_size )
+        return;
+    // Encode the entry
+    start = std::max( start, d_offset );
+    stop  = std::max( stop, start );
+    uint8_t data[MAX_BYTES];
+    size_t n = encodeLEB128( start - d_offset, data );
+    n += encodeLEB128( stop - start, &data[n] );
+    // Store the data (adding blocks as needed)
+    if ( !d_last ) {
+        d_first = newBlock();
+        d_last  = d_first;
+        d_head  = 0;
+        d_tail  = 0;
+    }
+    for ( size_t j = 0; j < n; ) {
+        if ( d_tail == BLOCK_BYTES ) {
+            d_last->next = newBlock();
+            d_last       = d_last->next;
+            d_tail       = 0;
+        }
+        size_t n1 = std::min( n - j, BLOCK_BYTES - d_tail );
+        memcpy( &d_last->data[d_tail], &data[j], n1 );
+        d_tail += n1;
+        j += n1;
+    }
+    d_length += n;
+    d_offset = stop;
+    d_size++;
+}
+uint8_t* ProfilerApp::StoreTimes::copy(
+    const View& view, uint64_t shift, uint64_t first, size_t& N )
+{
+    // Skip the entries that end before first
+    const Block* block = view.first;
+    size_t i = view.head, size = view.size, length = view.length;
+    uint64_t base = view.base, start = 0, dt = 0;
+    bool found = false;
+    while ( size > 0 && !found ) {
+        auto block0 = block;
+        size_t i0   = i;
+        read( block, i, start, dt );
+        length -= block == block0 ? i - i0 : BLOCK_BYTES - i0 + i;
+        size--;
+        found = base + start + dt >= first;
+        if ( !found )
+            base += start + dt;
+    }
+    N = 0;
+    if ( !found )
+        return nullptr;
+    // Store the first entry relative to zero (including the shift)
+    auto data  = allocate<uint8_t>( length + MAX_BYTES );
+    size_t pos = encodeLEB128( base + start + shift, data );
+    pos += encodeLEB128( dt, &data[pos] );
+    // Copy the remaining entries (flattening the blocks)
+    while ( length > 0 && block ) {
+        if ( i == BLOCK_BYTES ) {
+            block = block->next;
+            i     = 0;
+            continue;
+        }
+        size_t n1 = std::min( length, BLOCK_BYTES - i );
+        memcpy( &data[pos], &block->data[i], n1 );
+        pos += n1;
+        i += n1;
+        length -= n1;
+    }
+    N = size + 1;
+    return data;
+}
+uint8_t* ProfilerApp::StoreTimes::take()
+{
+    size_t N = 0;
+    auto ptr = copy( view(), 0, 0, N );
+    clear();
     return ptr;
 }
+template<class FUN>
+inline void ProfilerApp::StoreTimes::spill( FUN write )
+{
+    if ( d_first == d_last )
+        return;
+    // Remove the entries (the block is recycled but the data is not modified)
+    auto block = d_first;
+    size_t i   = d_head;
+    size_t N   = 0;
+    while ( d_first == block && d_size > 0 ) {
+        pop();
+        N++;
+    }
+    // Copy the raw bytes (the last entry may end in the next block)
+    uint8_t data[BLOCK_BYTES + MAX_BYTES];
+    size_t n = BLOCK_BYTES - i;
+    memcpy( data, &block->data[i], n );
+    if ( d_first != block ) {
+        memcpy( &data[n], d_first->data, d_head );
+        n += d_head;
+    }
+    write( data, n, N );
+}
 
 
 /***********************************************************************
  * StoreMemory                                                          *
  ***********************************************************************/
-ProfilerApp::StoreMemory::StoreMemory()
-    : d_capacity( 0 ), d_size( 0 ), d_time( nullptr ), d_bytes( nullptr )
-{
-}
-ProfilerApp::StoreMemory::~StoreMemory()
+ProfilerApp::StoreMemory::StoreMemory( Arena& arena )
+    : d_arena( &arena ),
+      d_first( nullptr ),
+      d_last( nullptr ),
+      d_size( 0 ),
+      d_tail( 0 ),
+      d_bytes2( 0 )
 {
-    delete[] d_time;
-    delete[] d_bytes;
 }
 inline void ProfilerApp::StoreMemory::add(
     uint64_t time, ProfilerApp::MemoryLevel level, volatile std::atomic_int64_t& bytes_profiler )
@@ -385,50 +583,54 @@ inline void ProfilerApp::StoreMemory::add(
     }
 #endif
     bytes_profiler.fetch_sub( bytes );
-    // Check if we need to allocate more memory
-    if ( d_size == d_capacity ) {
-        auto old_c = d_capacity;
-        d_capacity *= 2;
-        d_capacity = std::max<size_t>( d_capacity, 1024 );
-        d_capacity = std::min<size_t>( d_capacity, MAX_ENTRIES );
-        resize( d_time, d_capacity );
-        resize( d_bytes, d_capacity );
-        bytes_profiler.fetch_add( ( d_capacity - old_c ) * 16 );
+    // Replace the last entry if the memory usage has not changed
+    if ( d_size >= 2 && bytes == d_last->bytes[d_tail - 1] && bytes == d_bytes2 ) {
+        d_last->time[d_tail - 1] = time;
+        return;
     }
-    // Store the entry
-    size_t i = d_size;
-    if ( i < 2 ) {
-        d_time[i]  = time;
-        d_bytes[i] = bytes;
-        d_size++;
-    } else if ( bytes == d_bytes[i - 1] && bytes == d_bytes[i - 2] ) {
-        d_time[i - 1] = time;
-    } else {
-        d_time[i]  = time;
-        d_bytes[i] = bytes;
-        d_size++;
+    // Add a new block if needed (the blocks are owned by the arena)
+    uint64_t last = d_size > 0 ? d_last->bytes[d_tail - 1] : 0;
+    if ( !d_last || d_tail == BLOCK_ENTRIES ) {
+        auto block  = reinterpret_cast<Block*>( d_arena->allocate( sizeof( Block ) ) );
+        block->next = nullptr;
+        if ( d_last )
+            d_last->next = block;
+        else
+            d_first = block;
+        d_last = block;
+        d_tail = 0;
     }
+    // Store the entry
+    d_bytes2              = last;
+    d_last->time[d_tail]  = time;
+    d_last->bytes[d_tail] = bytes;
+    d_tail++;
+    d_size++;
 }
 void ProfilerApp::StoreMemory::reset() volatile
 {
-    d_size     = 0;
-    d_capacity = 0;
-    free( d_time );
-    free( d_bytes );
-    d_time  = nullptr;
-    d_bytes = nullptr;
+    // The blocks are released with the arena
+    d_first  = nullptr;
+    d_last   = nullptr;
+    d_size   = 0;
+    d_tail   = 0;
+    d_bytes2 = 0;
 }
 void ProfilerApp::StoreMemory::get(
     std::vector<uint64_t>& time, std::vector<uint64_t>& bytes ) const volatile
 {
-    if ( d_size == 0 ) {
-        time.clear();
-        bytes.clear();
+    size_t N = d_size;
+    time.resize( N );
+    bytes.resize( N );
+    size_t i = 0;
+    for ( const Block* block = d_first; block && i < N; block = block->next ) {
+        size_t n = std::min( N - i, BLOCK_ENTRIES );
+        memcpy( &time[i], block->time, n * sizeof( uint64_t ) );
+        memcpy( &bytes[i], block->bytes, n * sizeof( uint64_t ) );
+        i += n;
     }
-    time.resize( d_size );
-    bytes.resize( d_size );
-    memcpy( time.data(), d_time, d_size * sizeof( uint64_t ) );
-    memcpy( bytes.data(), d_bytes, d_size * sizeof( uint64_t ) );
+    time.resize( i );
+    bytes.resize( i );
 }
 
 
@@ -437,53 +639,34 @@ void ProfilerApp::StoreMemory::get(
  ***********************************************************************/
 ProfilerApp::store_timer::store_timer()
     : id( 0 ),
-      alloc_msg( false ),
-      alloc_file( false ),
       line( 0 ),
       message( nullptr ),
       filename( nullptr ),
       trace_head( nullptr ),
-      next( nullptr )
+      last( nullptr ),
+      N_trace( 0 )
 {
 }
 ProfilerApp::store_timer::store_timer( uint64_t id_, const char* message_, const char* filename_,
-    int line_, bool static_msg, bool static_file )
+    int line_, bool static_msg, bool static_file, Arena& arena )
     : id( id_ ),
-      alloc_msg( !static_msg ),
-      alloc_file( !static_file ),
       line( line_ ),
-      message( message_ ),
-      filename( filename_ ),
+      message( static_msg ? message_ : arena.copy( message_ ) ),
+      filename( static_file ? filename_ : arena.copy( filename_ ) ),
       trace_head( nullptr ),
-      next( nullptr )
+      last( nullptr ),
+      N_trace( 0 )
 {
-    size_t N1 = 0, N2 = 0;
-    if ( alloc_msg ) {
-        N1      = strlen( message_ ) + 1;
-        message = new char[N1];
-        memcpy( (void*) message, message_, N1 );
-    }
-    if ( alloc_file ) {
-        N2       = strlen( filename_ ) + 1;
-        filename = new char[N2];
-        memcpy( (void*) filename, filename_, N2 );
-    }
-    ProfilerApp::d_bytes.fetch_add( N1 + N2 );
 }
 ProfilerApp::store_timer::~store_timer()
 {
-    size_t N = 0;
-    if ( alloc_msg ) {
-        N += message ? strlen( message ) + 1 : 0;
-        delete[] message;
-    }
-    if ( alloc_file ) {
-        N += message ? strlen( filename ) + 1 : 0;
-        delete[] filename;
+    // The traces are stored in the arena, we only need to call the destructors
+    auto trace = trace_head;
+    while ( trace ) {
+        auto next = trace->next;
+        trace->~store_trace();
+        trace = next;
     }
-    ProfilerApp::d_bytes.fetch_sub( N );
-    delete trace_head;
-    delete next;
 }
 
 
@@ -491,7 +674,7 @@ ProfilerApp::store_timer::~store_timer()
  * store_timer                                                          *
  ***********************************************************************/
 constexpr static uint64_t nullStart = static_cast<uint64_t>( (int64_t) -1 );
-ProfilerApp::store_trace::store_trace( uint64_t s )
+ProfilerApp::store_trace::store_trace( uint64_t s, Arena* arena )
     : start( nullStart ),
       stack( s ),
       stack2( 0 ),
@@ -499,10 +682,148 @@ ProfilerApp::store_trace::store_trace( uint64_t s )
       min_time( std::numeric_limits<uint64_t>::max() ),
       max_time( 0 ),
       total_time( 0 ),
-      next( nullptr )
+      self_time( 0 ),
+      shift( 0 ),
+      sum_sq( 0 ),
+      child_time( 0 ),
+      cpu_start( 0 ),
+      cpu_time( 0 ),
+      perf0{ 0, 0, 0, 0, 0, 0 },
+      perf{ 0, 0, 0, 0 },
+      hist( nullptr ),
+      slow( nullptr ),
+      perf_set( CounterSet::None ),
+      perf_sum( CounterSet::None ),
+      N_child( 0 ),
+      N_desc( 0 ),
+      desc_calls( 0 ),
+      N_timed( 0 ),
+      check_time( 0 ),
+      stride( 1 ),
+      skip( 0 ),
+      times( arena ),
+      parent( nullptr ),
+      next( nullptr ),
+      seq( 0 )
 {
 }
-ProfilerApp::store_trace::~store_trace() { delete next; }
+
+
+/***********************************************************************
+ * Arena                                                                *
+ ***********************************************************************/
+ProfilerApp::Arena::Arena() : d_ptr( nullptr ), d_end( nullptr ), d_head( nullptr ), d_bytes( 0 )
+{
+}
+ProfilerApp::Arena::~Arena() { reset(); }
+inline void* ProfilerApp::Arena::allocate( size_t bytes )
+{
+    bytes = ( bytes + 15 ) & ~( (size_t) 15 );
+    if ( bytes > static_cast<size_t>( d_end - d_ptr ) )
+        return allocateBlock( bytes );
+    auto ptr = d_ptr;
+    d_ptr += bytes;
+    return ptr;
+}
+void* ProfilerApp::Arena::allocateBlock( size_t bytes )
+{
+    // Large allocations get their own block, otherwise start a new block
+    size_t N    = bytes > BLOCK_SIZE / 4 ? bytes : BLOCK_SIZE - sizeof( Block );
+    auto block  = reinterpret_cast<Block*>( ::allocate<char>( N + sizeof( Block ) ) );
+    auto ptr    = reinterpret_cast<char*>( block ) + sizeof( Block );
+    block->next = d_head;
+    d_head      = block;
+    d_bytes += N + sizeof( Block );
+    ProfilerApp::d_bytes.fetch_add( N + sizeof( Block ) );
+    if ( bytes <= BLOCK_SIZE / 4 ) {
+        d_ptr = ptr + bytes;
+        d_end = ptr + N;
+    }
+    return ptr;
+}
+const char* ProfilerApp::Arena::copy( const char* str )
+{
+    size_t N = strlen( str ) + 1;
+    auto ptr = reinterpret_cast<char*>( allocate( N ) );
+    memcpy( ptr, str, N );
+    return ptr;
+}
+void ProfilerApp::Arena::reset()
+{
+    while ( d_head ) {
+        auto next = d_head->next;
+        free( d_head );
+        d_head = next;
+    }
+    d_ptr   = nullptr;
+    d_end   = nullptr;
+    d_bytes = 0;
+}
+
+
+/***********************************************************************
+ * HashTable                                                            *
+ ***********************************************************************/
+template<class TYPE>
+ProfilerApp::HashTable<TYPE>::HashTable()
+    : d_size( 0 ), d_capacity( 0 ), d_shift( 64 ), d_data( nullptr )
+{
+}
+template<class TYPE>
+ProfilerApp::HashTable<TYPE>::~HashTable()
+{
+    free( d_data );
+}
+template<class TYPE>
+void ProfilerApp::HashTable<TYPE>::insert( uint64_t key, TYPE* data )
+{
+    if ( full() )
+        grow();
+    size_t mask = d_capacity - 1;
+    size_t i    = hash( key, d_shift );
+    while ( d_data[i].data ) {
+        if ( d_data[i].key == key )
+            throw std::logic_error( "Key already exists in hash table" );
+        i = ( i + 1 ) & mask;
+    }
+    // Readers skip empty entries, make sure the data is visible before publishing it
+    d_data[i].key = key;
+    std::atomic_thread_fence( std::memory_order_release );
+    d_data[i].data = data;
+    d_size++;
+}
+template<class TYPE>
+void ProfilerApp::HashTable<TYPE>::grow()
+{
+    uint32_t N = std::max<uint32_t>( 2 * d_capacity, HASH_SIZE );
+    auto data  = allocate<Entry>( N );
+    memset( data, 0, N * sizeof( Entry ) );
+    int shift   = 64 - log2int( N );
+    size_t mask = N - 1;
+    for ( size_t j = 0; j < d_capacity; j++ ) {
+        if ( !d_data[j].data )
+            continue;
+        size_t i = hash( d_data[j].key, shift );
+        while ( data[i].data )
+            i = ( i + 1 ) & mask;
+        data[i] = d_data[j];
+    }
+    std::swap( data, d_data );
+    d_capacity = N;
+    d_shift    = shift;
+    free( data );
+}
+template<class TYPE>
+void ProfilerApp::HashTable<TYPE>::clear()
+{
+    free( d_data );
+    d_size     = 0;
+    d_capacity = 0;
+    d_shift    = 64;
+    d_data     = nullptr;
+}
+template class ProfilerApp::HashTable<ProfilerApp::store_timer>;
+template class ProfilerApp::HashTable<ProfilerApp::store_trace>;
 
 
 /***********************************************************************
@@ -512,13 +833,118 @@ static inline uint64_t getThreadHash()
 {
     return std::hash<std::thread::id>{}( std::this_thread::get_id() );
 }
-ProfilerApp::ThreadData::ThreadData() : id( 0 ), depth( 0 ), stack( 0 ), hash( 0 ), next( nullptr )
+static inline uint64_t getThreadCPU()
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    timespec ts;
+    clock_gettime( CLOCK_THREAD_CPUTIME_ID, &ts );
+    return 1000000000 * static_cast<uint64_t>( ts.tv_sec ) + ts.tv_nsec;
+#else
+    return 0; // The thread CPU time is not available
+#endif
+}
+static inline uint64_t getThreadCPU( [[maybe_unused]] const ProfilerApp::ThreadData& thread )
+{
+    // Read the CPU time of another thread (0 if not available)
+#if defined( __linux__ ) && defined( CLOCK_THREAD_CPUTIME_ID )
+    timespec ts;
+    if ( thread.cpu_clock == -1 || clock_gettime( thread.cpu_clock, &ts ) != 0 )
+        return 0;
+    return 1000000000 * static_cast<uint64_t>( ts.tv_sec ) + ts.tv_nsec;
+#else
+    return 0;
+#endif
+}
+static void closeCounters( int* fd )
+{
+#ifdef TIMER_ENABLE_PERF
+    for ( int i = 3; i >= 0; i-- ) {
+        if ( fd[i] >= 0 )
+            close( fd[i] );
+        fd[i] = -1;
+    }
+#endif
+}
+static bool openCounters( [[maybe_unused]] ProfilerApp::CounterSet set, [[maybe_unused]] int* fd )
+{
+#ifdef TIMER_ENABLE_PERF
+    // Open the counters for the calling thread as a group so they are read together
+    constexpr uint64_t hardware[4] = { PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+    constexpr uint64_t software[4] = { PERF_COUNT_SW_TASK_CLOCK, PERF_COUNT_SW_PAGE_FAULTS,
+        PERF_COUNT_SW_CONTEXT_SWITCHES, PERF_COUNT_SW_CPU_MIGRATIONS };
+    bool hw = set == ProfilerApp::CounterSet::Hardware;
+    for ( int i = 0; i < 4; i++ ) {
+        perf_event_attr attr;
+        memset( &attr, 0, sizeof( attr ) );
+        attr.size           = sizeof( attr );
+        attr.type           = hw ? PERF_TYPE_HARDWARE : PERF_TYPE_SOFTWARE;
+        attr.config         = hw ? hardware[i] : software[i];
+        attr.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.exclude_kernel = hw ? 1 : 0; // Software events are counted by the kernel
+        attr.exclude_hv     = 1;
+        int group           = i == 0 ? -1 : fd[0];
+        fd[i] = static_cast<int>( syscall( __NR_perf_event_open, &attr, 0, -1, group, 0 ) );
+        if ( fd[i] < 0 ) {
+            closeCounters( fd );
+            return false;
+        }
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+static inline ProfilerApp::CounterSet readCounters(
+    [[maybe_unused]] ProfilerApp::ThreadData& thread, [[maybe_unused]] ProfilerApp::CounterSet set,
+    [[maybe_unused]] uint64_t* x )
+{
+#ifdef TIMER_ENABLE_PERF
+    if ( thread.perf_set != set ) {
+        // Reopen the counters for the thread (we only try once for each counter set)
+        closeCounters( thread.perf_fd );
+        thread.perf_set = set;
+        if ( !openCounters( set, thread.perf_fd ) )
+            thread.perf_fd[0] = -2;
+    }
+    if ( thread.perf_fd[0] < 0 )
+        return ProfilerApp::CounterSet::None;
+    // Read the counters followed by the time enabled/running (used to scale multiplexed counts)
+    uint64_t data[7];
+    if ( read( thread.perf_fd[0], data, sizeof( data ) ) != sizeof( data ) )
+        return ProfilerApp::CounterSet::None;
+    memcpy( x, &data[3], 4 * sizeof( uint64_t ) );
+    x[4] = data[1];
+    x[5] = data[2];
+    return set;
+#else
+    return ProfilerApp::CounterSet::None;
+#endif
+}
+ProfilerApp::ThreadData::ThreadData( bool assignId )
+    : id( 0 ),
+      depth( 0 ),
+      stack( 0 ),
+      hash( 0 ),
+      next( nullptr ),
+      active( nullptr ),
+      N_index( 0 ),
+      index( nullptr ),
+      memory( arena ),
+      perf_set( CounterSet::None ),
+      perf_fd{ -1, -1, -1, -1 },
+      cpu_clock( -1 )
 {
     static volatile std::atomic_uint32_t N_threads = 0;
-    id                                             = N_threads++;
-    hash                                           = getThreadHash();
-    for ( size_t i = 0; i < HASH_SIZE; i++ )
-        timers[i] = nullptr;
+    if ( assignId )
+        id = N_threads++;
+    hash = getThreadHash();
+#if defined( __linux__ ) && defined( CLOCK_THREAD_CPUTIME_ID )
+    clockid_t clock;
+    if ( pthread_getcpuclockid( pthread_self(), &clock ) == 0 )
+        cpu_clock = clock;
+#endif
 }
 ProfilerApp::ThreadData::~ThreadData()
 {
@@ -527,17 +953,27 @@ ProfilerApp::ThreadData::~ThreadData()
         free( const_cast<ThreadData*>( next ) );
         next = nullptr;
     }
-    for ( size_t i = 0; i < HASH_SIZE; i++ )
-        delete timers[i];
+    for ( size_t i = 0; i < timers.capacity(); i++ ) {
+        if ( timers[i] )
+            timers[i]->~store_timer();
+    }
+    free( index );
+    closeCounters( perf_fd );
 }
-void ProfilerApp::ThreadData::reset() volatile
+void ProfilerApp::ThreadData::reset()
 {
-    depth = 0;
-    stack = 0;
-    for ( size_t i = 0; i < HASH_SIZE; i++ ) {
-        delete timers[i];
-        timers[i] = nullptr;
+    depth   = 0;
+    stack   = 0;
+    active  = nullptr;
+    N_index = 0;
+    free( index );
+    index = nullptr;
+    for ( size_t i = 0; i < timers.capacity(); i++ ) {
+        if ( timers[i] )
+            timers[i]->~store_timer();
     }
+    timers.clear();
+    arena.reset();
     memory.reset();
     if ( next )
         next->reset();
@@ -628,6 +1064,14 @@ std::array<char, 12> id_struct::str() const { return hash_to_str( data ); }
 /***********************************************************************
  * TraceResults                                                         *
  ***********************************************************************/
+// Free the detailed trace data (the data is not owned if it is in a mapped file)
+static inline void freeTimes( TraceResults& trace )
+{
+    if ( !trace.file )
+        free( trace.times );
+    trace.times = nullptr;
+    trace.file.reset();
+}
 TraceResults::TraceResults()
     : thread( 0 ),
       rank( 0 ),
@@ -635,17 +1079,31 @@ TraceResults::TraceResults()
       min( static_cast<double>( std::numeric_limits<uint64_t>::max() - 1 ) ),
       max( 0 ),
       tot( 0 ),
+      self( -1 ),
+      cpu( -1 ),
+      stdev( -1 ),
+      overhead( 0 ),
       N( 0 ),
+      N_timed( 0 ),
+      N_child( 0 ),
+      N_desc( 0 ),
+      perf_set( 0 ),
+      perf{ 0, 0, 0, 0 },
       stack( 0 ),
       stack2( 0 ),
-      times( nullptr )
+      times( nullptr ),
+      hist( nullptr ),
+      slow( nullptr )
 {
     ASSERT( str_to_hash( hash_to_str( 0x32eb809d ).data() ) == 0x32eb809d );
 }
 TraceResults::~TraceResults()
 {
-    free( times );
-    times = nullptr;
+    freeTimes( *this );
+    free( hist );
+    free( slow );
+    hist = nullptr;
+    slow = nullptr;
 }
 TraceResults::TraceResults( TraceResults&& rhs )
     : id( rhs.id ),
@@ -655,13 +1113,27 @@ TraceResults::TraceResults( TraceResults&& rhs )
       min( rhs.min ),
       max( rhs.max ),
       tot( rhs.tot ),
+      self( rhs.self ),
+      cpu( rhs.cpu ),
+      stdev( rhs.stdev ),
+      overhead( rhs.overhead ),
       N( rhs.N ),
+      N_timed( rhs.N_timed ),
+      N_child( rhs.N_child ),
+      N_desc( rhs.N_desc ),
+      perf_set( rhs.perf_set ),
+      perf{ rhs.perf[0], rhs.perf[1], rhs.perf[2], rhs.perf[3] },
       stack( rhs.stack ),
       stack2( rhs.stack2 ),
-      times( rhs.times )
+      times( rhs.times ),
+      hist( rhs.hist ),
+      slow( rhs.slow ),
+      file( std::move( rhs.file ) )
 {
     rhs.N_trace = 0;
     rhs.times   = nullptr;
+    rhs.hist    = nullptr;
+    rhs.slow    = nullptr;
 }
 TraceResults& TraceResults::operator=( TraceResults&& rhs )
 {
@@ -675,11 +1147,22 @@ TraceResults& TraceResults::operator=( TraceResults&& rhs )
     min         = rhs.min;
     max         = rhs.max;
     tot         = rhs.tot;
+    self        = rhs.self;
+    cpu         = rhs.cpu;
+    stdev       = rhs.stdev;
+    overhead    = rhs.overhead;
+    N_timed     = rhs.N_timed;
+    N_child     = rhs.N_child;
+    N_desc      = rhs.N_desc;
+    perf_set    = rhs.perf_set;
+    memcpy( perf, rhs.perf, sizeof( perf ) );
     stack       = rhs.stack;
     stack2      = rhs.stack2;
-    times       = rhs.times;
+    std::swap( times, rhs.times );
+    std::swap( hist, rhs.hist );
+    std::swap( slow, rhs.slow );
+    std::swap( file, rhs.file );
     rhs.N_trace = 0;
-    rhs.times   = nullptr;
     return *this;
 }
 size_t TraceResults::size( bool store_trace ) const
@@ -692,11 +1175,26 @@ size_t TraceResults::size( bool store_trace ) const
     bytes += sizeof( min );
     bytes += sizeof( max );
     bytes += sizeof( tot );
+    bytes += sizeof( self );
+    bytes += sizeof( cpu );
+    bytes += sizeof( stdev );
+    bytes += sizeof( overhead );
     bytes += sizeof( N );
+    bytes += sizeof( N_timed );
+    bytes += sizeof( N_child );
+    bytes += sizeof( N_desc );
+    bytes += sizeof( perf_set );
+    bytes += sizeof( perf );
     bytes += sizeof( stack );
     bytes += sizeof( stack2 );
-    if ( store_trace )
-        bytes += 2 * N_trace * sizeof( uint16f );
+    if ( store_trace && N_trace > 0 )
+        bytes += sizeof( uint64_t ) + sizeLEB128( times, 2 * N_trace );
+    bytes += sizeof( bool );
+    if ( hist )
+        bytes += HIST_SIZE * sizeof( uint64_t );
+    bytes += sizeof( bool );
+    if ( slow )
+        bytes += 2 * SLOW_SIZE * sizeof( uint64_t );
     return bytes;
 }
 size_t TraceResults::pack( char* data, bool store_trace ) const
@@ -713,18 +1211,37 @@ size_t TraceResults::pack( char* data, bool store_trace ) const
     pack_buffer( min, pos, data );
     pack_buffer( max, pos, data );
     pack_buffer( tot, pos, data );
+    pack_buffer( self, pos, data );
+    pack_buffer( cpu, pos, data );
+    pack_buffer( stdev, pos, data );
+    pack_buffer( overhead, pos, data );
     pack_buffer( N, pos, data );
+    pack_buffer( N_timed, pos, data );
+    pack_buffer( N_child, pos, data );
+    pack_buffer( N_desc, pos, data );
+    pack_buffer( perf_set, pos, data );
+    pack_buffer( 4, perf, pos, data );
     pack_buffer( stack, pos, data );
     pack_buffer( stack2, pos, data );
     if ( N_trace > 0 && store_trace ) {
-        pack_buffer( 2 * N_trace, times, pos, data );
+        uint64_t length = sizeLEB128( times, 2 * N_trace );
+        pack_buffer( length, pos, data );
+        pack_buffer( length, times, pos, data );
     }
+    pack_buffer( hist != nullptr, pos, data );
+    if ( hist )
+        pack_buffer( HIST_SIZE, hist, pos, data );
+    pack_buffer( slow != nullptr, pos, data );
+    if ( slow )
+        pack_buffer( 2 * SLOW_SIZE, slow, pos, data );
     this2->N_trace = N_trace0;
     return pos;
 }
 size_t TraceResults::unpack( const char* data )
 {
-    delete[] times;
+    freeTimes( *this );
+    free( hist );
+    free( slow );
     size_t pos = 0;
     unpack_buffer( id, pos, data );
     unpack_buffer( thread, pos, data );
@@ -733,13 +1250,38 @@ size_t TraceResults::unpack( const char* data )
     unpack_buffer( min, pos, data );
     unpack_buffer( max, pos, data );
     unpack_buffer( tot, pos, data );
+    unpack_buffer( self, pos, data );
+    unpack_buffer( cpu, pos, data );
+    unpack_buffer( stdev, pos, data );
+    unpack_buffer( overhead, pos, data );
     unpack_buffer( N, pos, data );
+    unpack_buffer( N_timed, pos, data );
+    unpack_buffer( N_child, pos, data );
+    unpack_buffer( N_desc, pos, data );
+    unpack_buffer( perf_set, pos, data );
+    unpack_buffer( 4, perf, pos, data );
     unpack_buffer( stack, pos, data );
     unpack_buffer( stack2, pos, data );
     times = nullptr;
     if ( N_trace > 0 ) {
-        times = allocate<uint16f>( 2 * N_trace );
-        unpack_buffer( 2 * N_trace, times, pos, data );
+        uint64_t length = 0;
+        unpack_buffer( length, pos, data );
+        times = allocate<uint8_t>( length );
+        unpack_buffer( length, times, pos, data );
+    }
+    bool has_hist = false;
+    unpack_buffer( has_hist, pos, data );
+    hist = nullptr;
+    if ( has_hist ) {
+        hist = allocate<uint64_t>( HIST_SIZE );
+        unpack_buffer( HIST_SIZE, hist, pos, data );
+    }
+    bool has_slow = false;
+    unpack_buffer( has_slow, pos, data );
+    slow = nullptr;
+    if ( has_slow ) {
+        slow = allocate<uint64_t>( 2 * SLOW_SIZE );
+        unpack_buffer( 2 * SLOW_SIZE, slow, pos, data );
     }
     return pos;
 }
@@ -752,11 +1294,121 @@ bool TraceResults::operator==( const TraceResults& rhs ) const
     equal      = equal && approx_equal( min, rhs.min, 0.005 );
     equal      = equal && approx_equal( max, rhs.max, 0.005 );
     equal      = equal && approx_equal( tot, rhs.tot, 0.005 );
+    equal      = equal && approx_equal( self, rhs.self, 0.005 );
+    equal      = equal && approx_equal( cpu, rhs.cpu, 0.005 );
+    equal      = equal && approx_equal( stdev, rhs.stdev, 0.005 );
+    equal      = equal && approx_equal( overhead, rhs.overhead, 0.005 );
     equal      = equal && N == rhs.N;
+    equal      = equal && N_timed == rhs.N_timed;
+    equal      = equal && N_child == rhs.N_child;
+    equal      = equal && N_desc == rhs.N_desc;
+    equal      = equal && perf_set == rhs.perf_set;
+    equal      = equal && memcmp( perf, rhs.perf, sizeof( perf ) ) == 0;
     equal      = equal && stack == rhs.stack;
     equal      = equal && stack2 == rhs.stack2;
+    equal      = equal && ( hist == nullptr ) == ( rhs.hist == nullptr );
+    if ( equal && hist )
+        equal = memcmp( hist, rhs.hist, HIST_SIZE * sizeof( uint64_t ) ) == 0;
+    equal = equal && ( slow == nullptr ) == ( rhs.slow == nullptr );
+    if ( equal && slow )
+        equal = memcmp( slow, rhs.slow, 2 * SLOW_SIZE * sizeof( uint64_t ) ) == 0;
     return equal;
 }
+double TraceResults::histValue( int bin )
+{
+    if ( bin < HIST_SUB )
+        return bin;
+    int e          = bin / HIST_SUB + 2;
+    uint64_t width = (uint64_t) 1 << ( e - 3 );
+    uint64_t lower = ( HIST_SUB + bin % HIST_SUB ) * width;
+    return lower + 0.5 * width;
+}
+static float getPercentile( const uint64_t* hist, double p, float min, float max )
+{
+    uint64_t N = 0;
+    for ( int i = 0; i < TraceResults::HIST_SIZE; i++ )
+        N += hist[i];
+    if ( N == 0 )
+        return -1;
+    double target = 0.01 * p * N;
+    uint64_t sum  = 0;
+    int bin       = 0;
+    for ( bin = 0; bin < TraceResults::HIST_SIZE - 1; bin++ ) {
+        sum += hist[bin];
+        if ( sum >= target && sum > 0 )
+            break;
+    }
+    double value = TraceResults::histValue( bin );
+    return static_cast<float>( std::min<double>( std::max<double>( value, min ), max ) );
+}
+float TraceResults::percentile( double p ) const
+{
+    if ( !hist )
+        return -1;
+    return getPercentile( hist, p, min, max );
+}
+void TraceResults::getTimes( uint64_t* start, uint64_t* stop ) const
+{
+    size_t pos    = 0;
+    uint64_t last = 0;
+    for ( size_t i = 0; i < N_trace; i++ ) {
+        start[i] = last + decodeLEB128( times, pos );
+        stop[i]  = start[i] + decodeLEB128( times, pos );
+        last     = stop[i];
+    }
+}
+std::array<uint64_t, 2> TraceResults::getTimeRange() const
+{
+    // Decode the times without storing them
+    size_t pos     = 0;
+    uint64_t first = 0, last = 0;
+    for ( size_t i = 0; i < N_trace; i++ ) {
+        uint64_t start = last + decodeLEB128( times, pos );
+        last           = start + decodeLEB128( times, pos );
+        first          = i == 0 ? start : first;
+    }
+    return { first, last };
+}
+std::vector<TraceResults::TimesIndex> TraceResults::indexTimes( size_t stride ) const
+{
+    ASSERT( stride > 0 );
+    std::vector<TimesIndex> index;
+    index.reserve( N_trace / stride + 2 );
+    size_t pos    = 0;
+    uint64_t last = 0;
+    for ( size_t i = 0; i < N_trace; i++ ) {
+        if ( i % stride == 0 )
+            index.push_back( { i, pos, last } );
+        uint64_t start = last + decodeLEB128( times, pos );
+        last           = start + decodeLEB128( times, pos );
+    }
+    index.push_back( { N_trace, pos, last } );
+    return index;
+}
+void TraceResults::getTimes( const std::vector<TimesIndex>& index, uint64_t t0, uint64_t t1,
+    std::vector<uint64_t>& start, std::vector<uint64_t>& stop ) const
+{
+    start.clear();
+    stop.clear();
+    if ( index.empty() )
+        return;
+    // Find the last checkpoint where the previous calls stopped before t0
+    auto it = std::upper_bound( index.begin() + 1, index.end(), t0,
+                  []( uint64_t t, const TimesIndex& x ) { return t < x.last; } ) -
+              1;
+    size_t pos    = it->pos;
+    uint64_t last = it->last;
+    for ( size_t i = it->call; i < index.back().call; i++ ) {
+        uint64_t t = last + decodeLEB128( times, pos );
+        last       = t + decodeLEB128( times, pos );
+        if ( t > t1 )
+            break;
+        if ( last >= t0 ) {
+            start.push_back( t );
+            stop.push_back( last );
+        }
+    }
+}
 
 
 /***********************************************************************
@@ -809,6 +1461,45 @@ size_t TimerResults::unpack( const char* data )
         pos += t.unpack( &data[pos] );
     return pos;
 }
+float TimerResults::percentile( double p ) const
+{
+    // Merge the histograms for all threads/ranks
+    bool found = false;
+    float min  = std::numeric_limits<float>::max();
+    float max  = 0;
+    uint64_t hist[TraceResults::HIST_SIZE];
+    memset( hist, 0, sizeof( hist ) );
+    for ( const auto& t : trace ) {
+        if ( !t.hist )
+            continue;
+        found = true;
+        min   = std::min( min, t.min );
+        max   = std::max( max, t.max );
+        for ( int i = 0; i < TraceResults::HIST_SIZE; i++ )
+            hist[i] += t.hist[i];
+    }
+    if ( !found )
+        return -1;
+    return getPercentile( hist, p, min, max );
+}
+float TimerResults::stdev() const
+{
+    // Combine the mean and variance for all threads/ranks (Chan et al.)
+    double N = 0, mean = 0, M2 = 0;
+    for ( const auto& t : trace ) {
+        double N2 = t.N_timed;
+        if ( t.stdev < 0 || N2 == 0 )
+            continue;
+        double mean2 = t.tot / t.N;
+        double delta = mean2 - mean;
+        M2 += t.stdev * t.stdev * ( N2 - 1 ) + delta * delta * N * N2 / ( N + N2 );
+        mean += delta * N2 / ( N + N2 );
+        N += N2;
+    }
+    if ( N == 0 )
+        return -1;
+    return N > 1 ? std::sqrt( M2 / ( N - 1 ) ) : 0;
+}
 bool TimerResults::operator==( const TimerResults& rhs ) const
 {
     bool equal = id == rhs.id;
@@ -934,8 +1625,78 @@ bool TimerMemoryResults::operator==( const TimerMemoryResults& rhs ) const
 /***********************************************************************
  * Constructor/Destructor                                               *
  ***********************************************************************/
-void ProfilerApp::setStoreTrace( bool profile ) { d_store_trace_data = profile; }
-void ProfilerApp::setStoreMemory( MemoryLevel memory ) { d_store_memory_data = memory; }
+void ProfilerApp::setStoreTrace( bool profile )
+{
+    d_store_trace_data = profile;
+    if ( d_level >= 0 ) {
+        std::lock_guard<std::mutex> lock( d_lock );
+        calibrateOverhead();
+    }
+}
+void ProfilerApp::setTraceWindow( size_t N, double seconds )
+{
+    if ( seconds < 0 )
+        throw std::logic_error( "seconds must be >= 0" );
+    d_trace_size   = N;
+    d_trace_window = static_cast<uint64_t>( 1e9 * seconds );
+}
+void ProfilerApp::setTraceFilter( double min_time, double max_rate )
+{
+    if ( min_time < 0 || max_rate < 0 )
+        throw std::logic_error( "min_time and max_rate must be >= 0" );
+    d_trace_min = static_cast<uint64_t>( 1e9 * min_time );
+    d_trace_gap = max_rate > 0 ? static_cast<uint64_t>( 1e9 / max_rate ) : 0;
+}
+void ProfilerApp::setStoreCPU( bool cpu )
+{
+    d_store_cpu = cpu && getThreadCPU() != 0;
+    if ( d_level >= 0 ) {
+        std::lock_guard<std::mutex> lock( d_lock );
+        calibrateOverhead();
+    }
+}
+void ProfilerApp::setStoreCounters( bool counters )
+{
+    // Check which counters are available (falling back to the software counters)
+    int fd[4]      = { -1, -1, -1, -1 };
+    CounterSet set = CounterSet::None;
+    if ( counters && openCounters( CounterSet::Hardware, fd ) )
+        set = CounterSet::Hardware;
+    else if ( counters && openCounters( CounterSet::Software, fd ) )
+        set = CounterSet::Software;
+    closeCounters( fd );
+    d_counters = set;
+    if ( d_level >= 0 ) {
+        std::lock_guard<std::mutex> lock( d_lock );
+        calibrateOverhead();
+    }
+}
+void ProfilerApp::setStoreHistogram( bool hist )
+{
+    d_store_hist = hist;
+    if ( d_level >= 0 ) {
+        std::lock_guard<std::mutex> lock( d_lock );
+        calibrateOverhead();
+    }
+}
+void ProfilerApp::setStoreSlowest( bool slow )
+{
+    d_store_slow = slow;
+    if ( d_level >= 0 ) {
+        std::lock_guard<std::mutex> lock( d_lock );
+        calibrateOverhead();
+    }
+}
+void ProfilerApp::setSaveBinary( bool binary ) { d_save_binary = binary; }
+void ProfilerApp::setLoadThreads( int N_threads ) { d_load_threads = N_threads; }
+void ProfilerApp::setStoreMemory( MemoryLevel memory )
+{
+    d_store_memory_data = memory;
+    if ( d_level >= 0 ) {
+        std::lock_guard<std::mutex> lock( d_lock );
+        calibrateOverhead();
+    }
+}
 ProfilerApp::MemoryLevel ProfilerApp::getStoreMemory() { return d_store_memory_data; }
 
 
@@ -946,13 +1707,68 @@ void ProfilerApp::synchronize()
 {
     d_lock.lock();
     comm_barrier();
-    uint64_t ns     = diff_ns( std::chrono::steady_clock::now(), d_construct_time );
+    uint64_t ns     = getTime();
     uint64_t offset = comm_max_reduce( static_cast<double>( ns ) );
     d_shift         = offset - ns;
     d_lock.unlock();
 }
 
 
+/***********************************************************************
+ * Functions to set/calibrate the clock                                 *
+ * Note: We convert the TSC to ns using a 32.32 fixed point scale that  *
+ *   is measured against steady_clock over a short interval when the    *
+ *   profiler is enabled.  The scale is not changed while the timers    *
+ *   are running so that the times are continuous and monotonic.        *
+ ***********************************************************************/
+#ifdef TIMER_ENABLE_TSC
+static bool invariantTSC()
+{
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if ( !__get_cpuid( 0x80000000, &eax, &ebx, &ecx, &edx ) || eax < 0x80000007 )
+        return false;
+    if ( !__get_cpuid( 0x80000007, &eax, &ebx, &ecx, &edx ) )
+        return false;
+    return ( edx & ( 1 << 8 ) ) != 0;
+}
+#else
+static bool invariantTSC() { return false; }
+#endif
+void ProfilerApp::setClockSource( ClockSource clock )
+{
+    d_lock.lock();
+    if ( clock == ClockSource::TSC && !invariantTSC() )
+        clock = ClockSource::Steady;
+    if ( clock == ClockSource::TSC && d_clock != ClockSource::TSC && !calibrateTSC() )
+        clock = ClockSource::Steady;
+    d_clock = clock;
+    if ( d_level >= 0 )
+        calibrateOverhead();
+    d_lock.unlock();
+}
+bool ProfilerApp::calibrateTSC()
+{
+#ifdef TIMER_ENABLE_TSC
+    auto t0 = std::chrono::steady_clock::now();
+    auto c0 = __builtin_ia32_rdtsc();
+    // Measure the TSC over a short interval
+    auto t1 = t0;
+    auto c1 = c0;
+    while ( diff_ns( t1, t0 ) < 1000000 ) {
+        t1 = std::chrono::steady_clock::now();
+        c1 = __builtin_ia32_rdtsc();
+    }
+    double ns    = diff_ns( t1, t0 );
+    double ticks = c1 - c0;
+    d_tsc_scale  = static_cast<uint64_t>( ldexp( ns / ticks, 32 ) );
+    d_tsc_start  = c0 - static_cast<uint64_t>( diff_ns( t0, d_construct_time ) * ticks / ns );
+    return d_tsc_scale < ( (uint64_t) 1 << 32 ); // getTime requires a TSC of at least 1 GHz
+#else
+    return false;
+#endif
+}
+
+
 /***********************************************************************
  * Function to handle any errors                                        *
  ***********************************************************************/
@@ -990,57 +1806,498 @@ ProfilerApp::ThreadData* ProfilerApp::createThreadData()
 }
 
 
+/***********************************************************************
+ * Function to create a new timer                                       *
+ * Note: Only the owning thread modifies its table, but other threads   *
+ *   may be reading it (under the lock) so we must grow under the lock. *
+ ***********************************************************************/
+ProfilerApp::store_timer* ProfilerApp::addBlock( ThreadData* thread, uint64_t id,
+    const char* message, const char* filename, int line, bool static_msg, bool static_file )
+{
+    auto mem   = thread->arena.allocate( sizeof( store_timer ) );
+    auto timer = new ( mem )
+        store_timer( id, message, filename, line, static_msg, static_file, thread->arena );
+    if ( thread->timers.full() ) {
+        size_t bytes = thread->timers.bytes();
+        d_lock.lock();
+        thread->timers.grow();
+        d_lock.unlock();
+        d_bytes.fetch_add( thread->timers.bytes() - bytes );
+    }
+    thread->timers.insert( id, timer );
+    return timer;
+}
+
+
+/***********************************************************************
+ * Functions to register/add static timers                              *
+ * Note: the index is assigned once per call site during static         *
+ *   initialization and is shared by all threads.  Each thread lazily   *
+ *   fills its own table the first time a call site is reached.         *
+ ***********************************************************************/
+uint32_t ProfilerApp::registerTimer( uint64_t )
+{
+    static std::atomic_uint32_t N_index = 0;
+    return ++N_index;
+}
+ProfilerApp::store_timer* ProfilerApp::addStaticBlock( ThreadData* thread, uint32_t index,
+    uint64_t id, const char* message, const char* filename, int line )
+{
+    auto timer = getBlock( id, message, filename, line, true, true );
+    if ( index == 0 )
+        return timer; // The call site has not been registered (yet)
+    if ( index >= thread->N_index ) {
+        uint32_t N = std::max<uint32_t>( 2 * thread->N_index, 64 );
+        while ( N <= index )
+            N *= 2;
+        resize( thread->index, N );
+        for ( uint32_t i = thread->N_index; i < N; i++ )
+            thread->index[i] = nullptr;
+        d_bytes.fetch_add( ( N - thread->N_index ) * sizeof( store_timer* ) );
+        thread->N_index = N;
+    }
+    thread->index[index] = timer;
+    return timer;
+}
+
+
+/***********************************************************************
+ * Functions to find/add the trace for a calling stack                  *
+ * Note: We check the most recently used trace first, then search the   *
+ *   list if there are only a few traces or the hash table otherwise.   *
+ *   The traces are only accessed by the owning thread, other threads   *
+ *   iterate through the list so the table does not need the lock.      *
+ ***********************************************************************/
+constexpr static uint32_t MAX_TRACE_LIST = 4;
+inline ProfilerApp::store_trace* ProfilerApp::store_timer::findTrace( uint64_t stack )
+{
+    if ( last && last->stack == stack )
+        return last;
+    store_trace* trace = nullptr;
+    if ( N_trace <= MAX_TRACE_LIST ) {
+        for ( trace = trace_head; trace; trace = trace->next ) {
+            if ( trace->stack == stack )
+                break;
+        }
+    } else {
+        trace = traces.find( stack );
+    }
+    if ( trace )
+        last = trace;
+    return trace;
+}
+ProfilerApp::store_trace* ProfilerApp::store_timer::addTrace(
+    uint64_t stack, uint64_t stack2, Arena& arena )
+{
+    auto trace    = new ( arena.allocate( sizeof( store_trace ) ) ) store_trace( stack, &arena );
+    trace->stack2 = stack2;
+    size_t bytes  = traces.bytes();
+    if ( N_trace == MAX_TRACE_LIST ) {
+        // Switch to the hash table
+        for ( auto tmp = trace_head; tmp; tmp = tmp->next )
+            traces.insert( tmp->stack, tmp );
+    }
+    if ( N_trace >= MAX_TRACE_LIST )
+        traces.insert( stack, trace );
+    // Add the trace to the end of the list (other threads may be walking the list)
+    std::atomic_thread_fence( std::memory_order_release );
+    if ( trace_head ) {
+        auto tmp = trace_head;
+        while ( tmp->next )
+            tmp = tmp->next;
+        tmp->next = trace;
+    } else {
+        trace_head = trace;
+    }
+    N_trace++;
+    last = trace;
+    ProfilerApp::d_bytes.fetch_add( traces.bytes() - bytes );
+    return trace;
+}
+
+
 /***********************************************************************
  * Function to start profiling a block of code                          *
  ***********************************************************************/
-ProfilerApp::store_trace* ProfilerApp::start( store_timer* timer )
+inline ProfilerApp::store_trace* ProfilerApp::start( ThreadData& thread, store_timer* timer )
 {
-    auto& thread = *getThreadData();
     // Update the stack
     auto stack = thread.stack;
     thread.stack =
         ( ( thread.stack << 7 ) | ( thread.stack >> 57 ) ) ^ ( timer->id + 13 * thread.depth );
     thread.depth++;
     // Find the trace to start (creating if needed)
-    store_trace* trace = nullptr;
-    if ( timer->trace_head ) {
-        trace     = timer->trace_head;
-        auto last = trace;
-        while ( trace ) {
-            if ( trace->stack == stack )
+    auto trace = timer->findTrace( stack );
+    if ( !trace )
+        trace = timer->addTrace( stack, thread.stack, thread.arena );
+    // Start the timer
+    if ( trace->start != nullStart ) {
+        error( "Trace is active", &thread, timer );
+        return nullptr;
+    }
+    trace->parent = thread.active;
+    thread.active = trace;
+    if ( trace->stride > 1 ) {
+        // The trace is throttled, only time every Nth call
+        if ( ++trace->skip < trace->stride ) {
+            trace->beginUpdate();
+            trace->child_time = 0;
+            trace->desc_calls = 0;
+            trace->start      = store_trace::skipStart;
+            trace->endUpdate();
+            return trace;
+        }
+        trace->skip = 0;
+    }
+    trace->cpu_start = d_store_cpu ? getThreadCPU() : 0;
+    trace->perf_set  = CounterSet::None;
+    if ( d_counters != CounterSet::None )
+        trace->perf_set = readCounters( thread, d_counters, trace->perf0 );
+    trace->beginUpdate();
+    trace->child_time = 0;
+    trace->desc_calls = 0;
+    trace->start      = getTime();
+    trace->endUpdate();
+    // Record the memory usage
+    if ( static_cast<int>( d_store_memory_data ) >= 2 )
+        thread.memory.add( trace->start, d_store_memory_data, d_bytes );
+    return trace;
+}
+ProfilerApp::store_trace* ProfilerApp::start( store_timer* timer )
+{
+    return start( *getThreadData(), timer );
+}
+
+
+/***********************************************************************
+ * Stream the detailed trace data to disk from a background thread      *
+ * Note: The owning thread removes the entries in the first block of a  *
+ *   trace once it is full (see StoreTimes::spill) and queues a copy.   *
+ *   The writer appends each chunk to filename.x.stream as a header     *
+ *   followed by the raw bytes.  The chunks of a trace continue the     *
+ *   deltas of the previous chunk (the first chunk starts from 0).      *
+ *   save records the size of the file after the chunks queued before   *
+ *   the results were copied so load ignores the chunks written later.  *
+ ***********************************************************************/
+class TraceStream final
+{
+public:
+    TraceStream()
+        : d_active( false ), d_stop( true ), d_running( false ), d_rank( 0 ), d_queued( 0 ),
+          d_written( 0 ), d_bytes( 0 ), d_head( nullptr ), d_tail( nullptr ), d_fid( nullptr )
+    {
+    }
+    ~TraceStream() { close(); }
+    inline bool active() const { return d_active.load( std::memory_order_relaxed ); }
+    inline const std::string& prefix() const { return d_prefix; }
+    void open( const std::string& prefix )
+    {
+        close();
+        d_rank        = comm_rank();
+        auto filename = prefix + "." + std::to_string( d_rank + 1 ) + ".stream";
+        d_fid         = fopen( filename.data(), "wb" );
+        if ( d_fid == nullptr )
+            throw std::logic_error( "Error opening file for writing (stream): " + filename );
+        d_prefix = prefix;
+        d_mutex.lock();
+        d_stop    = false;
+        d_running = true;
+        d_mutex.unlock();
+        d_thread = std::thread( &TraceStream::run, this );
+        d_active = true;
+    }
+    void close()
+    {
+        d_active = false;
+        if ( !d_thread.joinable() )
+            return;
+        d_mutex.lock();
+        d_stop = true;
+        d_mutex.unlock();
+        d_wake.notify_all();
+        d_thread.join();
+        fclose( d_fid );
+        d_fid = nullptr;
+        d_prefix.clear();
+        // Discard any chunks that were queued while closing (write drops them once stopped)
+        std::lock_guard<std::mutex> lock( d_mutex );
+        while ( d_head ) {
+            auto next = d_head->next;
+            free( d_head );
+            d_head = next;
+        }
+        d_tail    = nullptr;
+        d_queued  = 0;
+        d_written = 0;
+        d_bytes   = 0;
+    }
+    void write( uint32_t thread, uint64_t stack2, uint64_t shift, const uint8_t* data,
+        size_t bytes, size_t N )
+    {
+        // Format the header so we know the size of the chunk in the file
+        char header[256];
+        unsigned long shift2 = shift, N2 = N, bytes2 = bytes;
+        size_t n = snprintf( header, sizeof( header ),
+            "<thread=%u,rank=%i,stack2=%s,shift=%lu,N=%lu,bytes=%lu>\n", thread, d_rank,
+            hash_to_str( stack2 ).data(), shift2, N2, bytes2 );
+        size_t size  = n + bytes + 1;
+        auto chunk   = reinterpret_cast<Chunk*>( allocate<uint8_t>( sizeof( Chunk ) + size ) );
+        auto ptr     = reinterpret_cast<uint8_t*>( chunk + 1 );
+        chunk->next  = nullptr;
+        chunk->bytes = size;
+        memcpy( ptr, header, n );
+        memcpy( &ptr[n], data, bytes );
+        ptr[n + bytes] = '\n';
+        std::lock_guard<std::mutex> lock( d_mutex );
+        if ( d_stop ) {
+            // The stream is closing (the timer passed the check in stopTrace before close)
+            free( chunk );
+            return;
+        }
+        if ( d_tail )
+            d_tail->next = chunk;
+        else
+            d_head = chunk;
+        d_tail = chunk;
+        d_queued++;
+        d_bytes += chunk->bytes;
+        d_wake.notify_one();
+    }
+    // Wait for the chunks queued before the call to be written (later chunks may also be
+    //    written), returns the size of the file after the chunks we waited for
+    uint64_t flush()
+    {
+        std::unique_lock<std::mutex> lock( d_mutex );
+        uint64_t ticket = d_queued;
+        uint64_t bytes  = d_bytes;
+        d_done.wait( lock, [this, ticket] { return d_written >= ticket || !d_running; } );
+        return bytes;
+    }
+
+private:
+    struct Chunk {
+        Chunk* next;  // Next chunk in the queue
+        size_t bytes; // Number of bytes (the header, data and newline follow)
+    };
+    void run()
+    {
+        std::unique_lock<std::mutex> lock( d_mutex );
+        while ( true ) {
+            d_wake.wait( lock, [this] { return d_stop || d_head; } );
+            if ( !d_head )
                 break;
-            last  = trace;
-            trace = trace->next;
+            auto chunk = d_head;
+            d_head     = nullptr;
+            d_tail     = nullptr;
+            lock.unlock();
+            size_t N = 0;
+            while ( chunk ) {
+                fwrite( chunk + 1, 1, chunk->bytes, d_fid );
+                auto next = chunk->next;
+                free( chunk );
+                chunk = next;
+                N++;
+            }
+            fflush( d_fid );
+            lock.lock();
+            d_written += N;
+            d_done.notify_all();
+        }
+        d_running = false;
+        d_done.notify_all();
+    }
+    std::atomic_bool d_active;
+    bool d_stop;        // Stop the writer (new chunks are dropped)
+    bool d_running;     // Is the writer running?
+    int d_rank;
+    uint64_t d_queued;  // Number of chunks queued
+    uint64_t d_written; // Number of chunks written
+    uint64_t d_bytes;   // Size of the file once the queued chunks are written
+    Chunk* d_head;
+    Chunk* d_tail;
+    FILE* d_fid;
+    std::string d_prefix;
+    std::mutex d_mutex;
+    std::condition_variable d_wake;
+    std::condition_variable d_done;
+    std::thread d_thread;
+};
+static TraceStream d_stream;
+void ProfilerApp::setTraceStream( const std::string& filename )
+{
+    d_stream.close();
+    if ( filename.empty() )
+        return;
+    if ( d_level < 0 )
+        throw std::logic_error( "The profiler must be enabled before streaming the trace data" );
+    d_stream.open( filename );
+}
+
+
+/***********************************************************************
+ * Function to stop profiling a block of code                           *
+ ***********************************************************************/
+// The slowest calls are kept as a min-heap of start/duration pairs (the root is the fastest)
+static inline void addSlowest( uint64_t* heap, uint64_t start, uint64_t ns )
+{
+    constexpr int N = TraceResults::SLOW_SIZE;
+    int i           = 0;
+    while ( 2 * i + 1 < N ) {
+        int j = 2 * i + 1;
+        if ( j + 1 < N && heap[2 * j + 3] < heap[2 * j + 1] )
+            j++;
+        if ( heap[2 * j + 1] >= ns )
+            break;
+        heap[2 * i]     = heap[2 * j];
+        heap[2 * i + 1] = heap[2 * j + 1];
+        i               = j;
+    }
+    heap[2 * i]     = start;
+    heap[2 * i + 1] = ns;
+}
+static inline void sortSlowest( uint64_t* slow, uint64_t shift )
+{
+    // Sort the calls by duration (slowest first) and shift the start times
+    for ( int i = 1; i < TraceResults::SLOW_SIZE; i++ ) {
+        uint64_t start = slow[2 * i];
+        uint64_t ns    = slow[2 * i + 1];
+        int j          = i;
+        for ( ; j > 0 && slow[2 * j - 1] < ns; j-- ) {
+            slow[2 * j]     = slow[2 * j - 2];
+            slow[2 * j + 1] = slow[2 * j - 1];
         }
-        if ( !trace ) {
-            last->next    = new store_trace( stack );
-            trace         = last->next;
-            trace->stack2 = thread.stack;
-            d_bytes.fetch_add( sizeof( store_trace ) );
+        slow[2 * j]     = start;
+        slow[2 * j + 1] = ns;
+    }
+    for ( int i = 0; i < TraceResults::SLOW_SIZE && slow[2 * i + 1] != 0; i++ )
+        slow[2 * i] += shift;
+}
+inline void ProfilerApp::stopTrace(
+    ThreadData& thread, store_trace* trace, uint64_t stop, int enableTrace )
+{
+    // Read the counters and allocate any storage before updating the trace
+    bool timed       = trace->timed();
+    auto start       = trace->start;
+    uint64_t ns      = 0;
+    uint64_t cpu     = 0;
+    uint64_t perf[6] = { 0, 0, 0, 0, 0, 0 };
+    bool has_perf    = false;
+    double perf_time = 1.0;
+    uint64_t* hist   = nullptr;
+    uint64_t* slow   = nullptr;
+    if ( timed ) {
+        ns = stop - start;
+        if ( trace->cpu_start != 0 )
+            cpu = getThreadCPU() - trace->cpu_start;
+        if ( trace->perf_set != CounterSet::None && trace->perf_set == thread.perf_set )
+            has_perf = readCounters( thread, trace->perf_set, perf ) == trace->perf_set;
+        if ( has_perf && perf[5] > trace->perf0[5] ) {
+            // Scale the counts if the counters were multiplexed (not running the whole call)
+            perf_time = static_cast<double>( perf[4] - trace->perf0[4] ) /
+                        static_cast<double>( perf[5] - trace->perf0[5] );
+        }
+        if ( d_store_hist ) {
+            hist = trace->hist;
+            if ( !hist ) {
+                constexpr size_t bytes = TraceResults::HIST_SIZE * sizeof( uint64_t );
+                hist = reinterpret_cast<uint64_t*>( thread.arena.allocate( bytes ) );
+                memset( hist, 0, bytes );
+            }
+        }
+        if ( d_store_slow ) {
+            slow = trace->slow;
+            if ( !slow ) {
+                constexpr size_t bytes = 2 * TraceResults::SLOW_SIZE * sizeof( uint64_t );
+                slow = reinterpret_cast<uint64_t*>( thread.arena.allocate( bytes ) );
+                memset( slow, 0, bytes );
+            }
         }
     } else {
-        timer->trace_head = new store_trace( stack );
-        trace             = timer->trace_head;
-        trace->stack2     = thread.stack;
-        d_bytes.fetch_add( sizeof( store_trace ) );
+        // The call was not timed (throttled), use the average time for the parent
+        ns = trace->total_time / trace->N_timed;
+    }
+    // Stop the trace (getTimerResults may be reading the trace from another thread)
+    trace->beginUpdate();
+    trace->start = nullStart;
+    trace->N_desc += trace->desc_calls;
+    trace->N_calls++;
+    if ( timed ) {
+        trace->max_time = std::max( trace->max_time, ns );
+        trace->min_time = std::min( trace->min_time, ns );
+        trace->total_time += ns;
+        trace->self_time += ns - std::min( ns, trace->child_time );
+        trace->N_timed++;
+        if ( trace->N_timed == 1 )
+            trace->shift = ns;
+        double dt = static_cast<int64_t>( ns - trace->shift );
+        trace->sum_sq += dt * dt;
+        if ( hist ) {
+            trace->hist = hist;
+            hist[TraceResults::histBin( ns )]++;
+        }
+        if ( slow ) {
+            trace->slow = slow;
+            if ( ns > slow[1] )
+                addSlowest( slow, start, ns );
+        }
+        trace->cpu_time += cpu;
+        if ( has_perf ) {
+            if ( trace->perf_sum != trace->perf_set ) {
+                // The counter set changed, restart the counts
+                memset( trace->perf, 0, sizeof( trace->perf ) );
+                trace->perf_sum = trace->perf_set;
+            }
+            for ( int i = 0; i < 4; i++ ) {
+                uint64_t count = perf[i] - trace->perf0[i];
+                trace->perf[i] += static_cast<uint64_t>( perf_time * count );
+            }
+        }
+    }
+    trace->endUpdate();
+    if ( timed && d_budget > 0 && ( trace->N_timed & 0x3FF ) == 0 )
+        throttle( trace, stop );
+    // Remove the trace from the active stack and add the time/calls to the parent
+    auto parent = trace->parent;
+    if ( parent ) {
+        parent->beginUpdate();
+        parent->child_time += ns;
+        parent->desc_calls += trace->desc_calls + 1;
+        parent->N_child++;
+        parent->endUpdate();
+    }
+    thread.active = parent;
+    if ( !timed )
+        return;
+    // Save the starting and ending time if we are storing the detailed traces
+    if ( enableTrace == -1 )
+        enableTrace = d_store_trace_data ? 1 : 0;
+    if ( enableTrace && ns < d_trace_min )
+        enableTrace = 0;
+    if ( enableTrace && d_trace_gap > 0 ) {
+        uint64_t last = trace->times.last();
+        if ( last > 0 && start < last + d_trace_gap )
+            enableTrace = 0;
     }
-    // Start the timer
-    if ( trace->start != nullStart ) {
-        error( "Trace is active", &thread, timer );
-        return nullptr;
+    if ( enableTrace && d_stream.active() ) {
+        // Stream the full blocks to disk (the ring buffer is not used)
+        trace->beginUpdate();
+        trace->times.add( start, stop );
+        if ( trace->times.full() ) {
+            trace->times.spill( [&thread, trace]( const uint8_t* data, size_t bytes, size_t N ) {
+                d_stream.write( thread.id, trace->stack2, d_shift, data, bytes, N );
+            } );
+        }
+        trace->endUpdate();
+    } else if ( enableTrace ) {
+        trace->beginUpdate();
+        trace->times.add( start, stop, d_trace_size, d_trace_window );
+        trace->endUpdate();
     }
-    trace->start = diff_ns( std::chrono::steady_clock::now(), d_construct_time );
-    // Record the memory usage
-    if ( static_cast<int>( d_store_memory_data ) >= 2 )
-        thread.memory.add( trace->start, d_store_memory_data, d_bytes );
-    return trace;
+    // Get the memory usage
+    if ( static_cast<int8_t>( d_store_memory_data ) >= 2 )
+        thread.memory.add( stop, d_store_memory_data, d_bytes );
 }
-
-
-/***********************************************************************
- * Function to stop profiling a block of code                           *
- ***********************************************************************/
-void ProfilerApp::stop( store_timer* timer, time_point end_time, int enableTrace )
+void ProfilerApp::stop( store_timer* timer, uint64_t stop, int enableTrace )
 {
     auto& thread = *getThreadData();
     // Update the stack
@@ -1049,12 +2306,7 @@ void ProfilerApp::stop( store_timer* timer, time_point end_time, int enableTrace
     uint64_t tmp = thread.stack ^ ( timer->id + 13 * thread.depth );
     thread.stack = ( tmp << 57 ) | ( tmp >> 7 );
     // Find the trace to stop
-    auto trace = timer->trace_head;
-    while ( trace ) {
-        if ( trace->stack == thread.stack )
-            break;
-        trace = trace->next;
-    }
+    auto trace = timer->findTrace( thread.stack );
     if ( !trace ) {
         error( "Unable to find trace, possible corrupted stack", &thread, timer );
         return;
@@ -1063,27 +2315,11 @@ void ProfilerApp::stop( store_timer* timer, time_point end_time, int enableTrace
         error( "Corrupted stack", &thread, timer );
         return;
     }
-    // Stop the trace
-    auto start      = trace->start;
-    uint64_t stop   = diff_ns( end_time, d_construct_time );
-    uint64_t ns     = stop - start;
-    trace->start    = nullStart;
-    trace->max_time = std::max( trace->max_time, ns );
-    trace->min_time = std::min( trace->min_time, ns );
-    trace->total_time += ns;
-    trace->N_calls++;
-    // Save the starting and ending time if we are storing the detailed traces
-    if ( enableTrace == -1 )
-        enableTrace = d_store_trace_data ? 1 : 0;
-    if ( enableTrace )
-        trace->times.add( start, stop );
-    // Get the memory usage
-    if ( static_cast<int8_t>( d_store_memory_data ) >= 2 )
-        thread.memory.add( stop, d_store_memory_data, d_bytes );
+    stopTrace( thread, trace, stop, enableTrace );
 }
-void ProfilerApp::stop( store_trace* trace, time_point end_time, int enableTrace )
+inline void ProfilerApp::stop(
+    ThreadData& thread, store_trace* trace, uint64_t stop, int enableTrace )
 {
-    auto& thread = *getThreadData();
     // Update the stack
     if ( trace->stack2 != thread.stack ) {
         error( "Corrupted stack", &thread, nullptr );
@@ -1091,23 +2327,73 @@ void ProfilerApp::stop( store_trace* trace, time_point end_time, int enableTrace
     }
     thread.stack = trace->stack;
     thread.depth--;
-    // Stop the trace
-    auto start      = trace->start;
-    uint64_t stop   = diff_ns( end_time, d_construct_time );
-    uint64_t ns     = stop - start;
-    trace->start    = nullStart;
-    trace->max_time = std::max( trace->max_time, ns );
-    trace->min_time = std::min( trace->min_time, ns );
-    trace->total_time += ns;
-    trace->N_calls++;
-    // Save the starting and ending time if we are storing the detailed traces
-    if ( enableTrace == -1 )
-        enableTrace = d_store_trace_data ? 1 : 0;
-    if ( enableTrace )
-        trace->times.add( start, stop );
-    // Get the memory usage
-    if ( static_cast<int8_t>( d_store_memory_data ) >= 2 )
-        thread.memory.add( stop, d_store_memory_data, d_bytes );
+    stopTrace( thread, trace, stop, enableTrace );
+}
+void ProfilerApp::stop( store_trace* trace, uint64_t stop, int enableTrace )
+{
+    ProfilerApp::stop( *getThreadData(), trace, stop, enableTrace );
+}
+
+
+/***********************************************************************
+ * Functions to throttle traces that exceed the overhead budget         *
+ * Note: We check the budget every 1024 timed calls.  The profiler cost *
+ *   over the interval is the number of timed calls times the overhead. *
+ ***********************************************************************/
+void ProfilerApp::setOverheadBudget( double fraction )
+{
+    if ( fraction < 0 || fraction >= 1 )
+        throw std::logic_error( "fraction must be in the range [0,1)" );
+    d_budget = fraction;
+}
+void ProfilerApp::throttle( store_trace* trace, uint64_t time )
+{
+    constexpr uint32_t max_stride = 0x10000;
+    double ns                     = time - trace->check_time;
+    double cost                   = 1024.0 * d_overhead;
+    trace->check_time             = time;
+    if ( cost > d_budget * ns && trace->stride < max_stride )
+        trace->stride *= 2;
+    else if ( 4 * cost < d_budget * ns && trace->stride > 1 )
+        trace->stride /= 2;
+    trace->skip = 0;
+}
+
+
+/***********************************************************************
+ * Function to measure the profiler overhead                            *
+ * Note: We time nested start/stop pairs (including the timer lookup)  *
+ *   on a private thread so the user timers are not modified.  The      *
+ *   overhead is the time each pair adds to the enclosing timer (the    *
+ *   minimum over several repeats).  The caller must hold d_lock.       *
+ ***********************************************************************/
+void ProfilerApp::calibrateOverhead()
+{
+    constexpr int N_calls  = 50;
+    constexpr int N_repeat = 20;
+    static_assert( N_calls * N_repeat < 1024, "The calibration must not be throttled" );
+    ThreadData thread( false );
+    auto outer = new ( thread.arena.allocate( sizeof( store_timer ) ) )
+        store_timer( 1, "outer", __FILE__, __LINE__, true, true, thread.arena );
+    auto inner = new ( thread.arena.allocate( sizeof( store_timer ) ) )
+        store_timer( 2, "inner", __FILE__, __LINE__, true, true, thread.arena );
+    uint64_t best = std::numeric_limits<uint64_t>::max();
+    thread.timers.insert( 1, outer );
+    thread.timers.insert( 2, inner );
+    for ( int it = 0; it < N_repeat; it++ ) {
+        auto trace = start( thread, outer );
+        for ( int i = 0; i < N_calls; i++ ) {
+            // Include the cost of finding the timer (see getBlock)
+            auto timer = thread.timers.find( 2 );
+            stop( thread, start( thread, timer ), getTime(), -1 );
+        }
+        uint64_t stop_time = getTime();
+        best               = std::min( best, stop_time - trace->start );
+        stop( thread, trace, stop_time, -1 );
+    }
+    inner->~store_timer();
+    outer->~store_timer();
+    d_overhead = static_cast<float>( best ) / N_calls;
 }
 
 
@@ -1117,7 +2403,7 @@ void ProfilerApp::stop( store_trace* trace, time_point end_time, int enableTrace
 void ProfilerApp::memory()
 {
     if ( static_cast<int8_t>( d_store_memory_data ) >= 2 ) {
-        int64_t ns  = diff_ns( std::chrono::steady_clock::now(), d_construct_time );
+        int64_t ns  = getTime();
         auto thread = getThreadData();
         thread->memory.add( ns, d_store_memory_data, d_bytes );
     }
@@ -1133,14 +2419,19 @@ void ProfilerApp::enable( int level )
     if ( level < 0 || level >= 128 )
         throw std::logic_error( "level must be in the range 0-127" );
     d_lock.lock();
-    if ( d_level < 0 )
+    if ( d_level < 0 ) {
         d_construct_time = std::chrono::steady_clock::now();
+        if ( d_clock == ClockSource::TSC && !calibrateTSC() )
+            d_clock = ClockSource::Steady;
+        calibrateOverhead();
+    }
     d_level = level;
     d_lock.unlock();
 }
 void ProfilerApp::disable()
 {
     // First, change the status flag
+    d_stream.close();
     d_lock.lock();
     d_level = -1;
     // Brief pause to ensure if any timers are in the process of updating they finish first
@@ -1175,22 +2466,15 @@ static inline void copyMessage( char* out, std::string_view in, size_t N )
     }
 }
 inline void ProfilerApp::getTimerResultsID(
-    uint64_t id, int rank, const time_point& end_time, TimerResults& results )
+    uint64_t id, int rank, uint64_t stop, TimerResults& results )
 {
-    constexpr uint64_t mask = HASH_SIZE - 1;
-    uint64_t key            = id & mask; // Get the hash index
-    results.id              = id_struct();
+    results.id = id_struct();
     // Loop through the thread entries
     auto thread = &d_threadData;
     while ( thread ) {
         auto thread_id = thread->id;
         // Search for a timer that matches the current id
-        auto timer = thread->timers[key];
-        while ( timer != nullptr ) {
-            if ( timer->id == id )
-                break;
-            timer = timer->next;
-        }
+        auto timer = thread->timers.find( id );
         if ( timer == nullptr ) {
             // The current thread does not have a copy of this timer, move on
             thread = thread->next;
@@ -1212,39 +2496,116 @@ inline void ProfilerApp::getTimerResultsID(
             }
         }
         // Loop through the trace entries
-        uint64_t stop      = diff_ns( end_time, d_construct_time );
         store_trace* trace = timer->trace_head;
         while ( trace != nullptr ) {
             size_t k = results.trace.size();
             results.trace.resize( k + 1 );
             // Get the running times of the trace
-            results.trace[k].id      = results.id;
-            results.trace[k].thread  = thread_id;
-            results.trace[k].rank    = rank;
-            results.trace[k].N       = trace->N_calls;
-            results.trace[k].N_trace = 0;
-            results.trace[k].min     = trace->min_time;
-            results.trace[k].max     = trace->max_time;
-            results.trace[k].tot     = trace->total_time;
-            results.trace[k].stack   = id_struct( trace->stack );
-            results.trace[k].stack2  = id_struct( trace->stack2 );
+            results.trace[k].id       = results.id;
+            results.trace[k].thread   = thread_id;
+            results.trace[k].rank     = rank;
+            results.trace[k].N_trace  = 0;
+            results.trace[k].overhead = d_overhead;
+            results.trace[k].stack    = id_struct( trace->stack );
+            results.trace[k].stack2   = id_struct( trace->stack2 );
+            // Copy the statistics without blocking the owning thread, retrying if the trace
+            //    was updated while we were reading it (the sequence number is odd during updates)
+            uint64_t start, total_time, cpu_start, cpu_time, child_time, desc_calls, shift;
+            double sum_sq;
+            StoreTimes::View times;
+            while ( true ) {
+                uint32_t seq = trace->seq.load( std::memory_order_acquire );
+                if ( seq & 0x1 ) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                start                    = trace->start;
+                total_time               = trace->total_time;
+                cpu_start                = trace->cpu_start;
+                cpu_time                 = trace->cpu_time;
+                child_time               = trace->child_time;
+                desc_calls               = trace->desc_calls;
+                shift                    = trace->shift;
+                sum_sq                   = trace->sum_sq;
+                times                    = trace->times.view();
+                results.trace[k].N       = trace->N_calls;
+                results.trace[k].N_timed = trace->N_timed;
+                results.trace[k].N_child = trace->N_child;
+                results.trace[k].N_desc  = trace->N_desc;
+                results.trace[k].min     = trace->min_time;
+                results.trace[k].max     = trace->max_time;
+                results.trace[k].self    = trace->self_time;
+                memcpy( results.trace[k].perf, trace->perf, sizeof( trace->perf ) );
+                results.trace[k].perf_set = static_cast<uint8_t>( trace->perf_sum );
+                auto hist = trace->hist;
+                if ( hist ) {
+                    auto& dst = results.trace[k].hist;
+                    if ( !dst )
+                        dst = allocate<uint64_t>( TraceResults::HIST_SIZE );
+                    memcpy( dst, hist, TraceResults::HIST_SIZE * sizeof( uint64_t ) );
+                }
+                auto slow = trace->slow;
+                if ( slow ) {
+                    auto& dst = results.trace[k].slow;
+                    if ( !dst )
+                        dst = allocate<uint64_t>( 2 * TraceResults::SLOW_SIZE );
+                    memcpy( dst, slow, 2 * TraceResults::SLOW_SIZE * sizeof( uint64_t ) );
+                }
+                std::atomic_thread_fence( std::memory_order_acquire );
+                if ( trace->seq.load( std::memory_order_relaxed ) == seq )
+                    break;
+            }
+            if ( results.trace[k].slow )
+                sortSlowest( results.trace[k].slow, d_shift );
+            uint64_t N_calls     = results.trace[k].N;
+            uint64_t N_timed     = results.trace[k].N_timed;
+            results.trace[k].tot = total_time;
+            results.trace[k].cpu = cpu_time;
+            if ( !d_store_cpu && cpu_time == 0 )
+                results.trace[k].cpu = -1; // We did not store the CPU time
+            if ( N_timed > 0 ) {
+                // Compute the variance from the sum of the squares shifted by the first call
+                double N   = N_timed;
+                auto sum   = total_time - N_timed * shift;
+                double dt  = static_cast<int64_t>( sum );
+                double var = ( sum_sq - dt * dt / N ) / std::max( N - 1, 1.0 );
+                results.trace[k].stdev = std::sqrt( std::max( var, 0.0 ) );
+            }
+            // Scale the times of a throttled trace by the number of calls
+            if ( N_timed > 0 && N_timed < N_calls ) {
+                double scale = static_cast<double>( N_calls ) / N_timed;
+                results.trace[k].tot *= scale;
+                results.trace[k].self *= scale;
+                results.trace[k].cpu *= scale;
+                for ( auto& x : results.trace[k].perf )
+                    x = static_cast<uint64_t>( scale * x );
+            }
             // Check if the trace is still running and update
-            if ( trace->start != nullStart ) {
-                uint64_t ns = stop - trace->start;
+            if ( start != nullStart && start != store_trace::skipStart ) {
+                uint64_t ns = stop - start;
                 results.trace[k].N++;
+                results.trace[k].N_timed++;
                 results.trace[k].min = std::min<float>( results.trace[k].min, ns );
                 results.trace[k].max = std::max<float>( results.trace[k].max, ns );
                 results.trace[k].tot += ns;
+                results.trace[k].self += ns - std::min( ns, child_time );
+                results.trace[k].N_desc += desc_calls;
+                uint64_t cpu = cpu_start != 0 ? getThreadCPU( *thread ) : 0;
+                if ( cpu > cpu_start )
+                    results.trace[k].cpu += std::min( cpu - cpu_start, ns ); // Read after stop
             }
             // Save the detailed trace results
-            if ( trace->times.size() > 0 ) {
-                StoreTimes times( trace->times, d_shift );
-                results.trace[k].N_trace = times.size();
-                results.trace[k].times   = times.take();
+            if ( times.size > 0 ) {
+                // The blocks are not recycled while we copy them (see getTimerResults)
+                uint64_t first = stop > d_trace_window ? stop - d_trace_window : 0;
+                size_t N = 0;
+                results.trace[k].times =
+                    StoreTimes::copy( times, d_shift, d_trace_window > 0 ? first : 0, N );
+                results.trace[k].N_trace = N;
             }
-            if ( d_store_trace_data && trace->N_calls == 0 && trace->start != nullStart ) {
+            if ( d_store_trace_data && N_calls == 0 && start != nullStart ) {
                 StoreTimes times;
-                times.add( d_shift + trace->start, d_shift + stop );
+                times.add( d_shift + start, d_shift + stop );
                 results.trace[k].N_trace = times.size();
                 results.trace[k].times   = times.take();
             }
@@ -1254,25 +2615,25 @@ inline void ProfilerApp::getTimerResultsID(
         thread = thread->next;
     }
 }
-std::vector<TimerResults> ProfilerApp::getTimerResults()
+std::vector<TimerResults> ProfilerApp::getTimerResults() { return getTimerResults( comm_rank() ); }
+std::vector<TimerResults> ProfilerApp::getTimerResults( int rank )
 {
     // Get the current time in case we need to "stop" and timers
-    auto end_time = std::chrono::steady_clock::now();
-    int rank      = comm_rank();
-    // Get a lock
+    auto end_time = getTime();
+    // Get a lock (the timed threads only wait on it to register a new timer or thread)
     d_lock.lock();
+    // Keep the timed threads from recycling the trace blocks while we copy them
+    d_times_readers++;
+    std::atomic_thread_fence( std::memory_order_seq_cst );
     // Get a list of all timer ids
     std::vector<uint64_t> ids;
     ids.reserve( 2048 );
     auto thread = &d_threadData;
     while ( thread ) {
-        for ( auto timer : thread->timers ) {
-            if ( !timer )
-                continue;
-            while ( timer ) {
+        for ( size_t i = 0; i < thread->timers.capacity(); i++ ) {
+            auto timer = thread->timers[i];
+            if ( timer )
                 ids.push_back( timer->id );
-                timer = timer->next;
-            }
         }
         thread = thread->next;
     }
@@ -1282,6 +2643,7 @@ std::vector<TimerResults> ProfilerApp::getTimerResults()
     for ( size_t i = 0; i < ids.size(); i++ )
         getTimerResultsID( ids[i], rank, end_time, results[i] );
     // Release the mutex
+    d_times_readers--;
     d_lock.unlock();
     return results;
 }
@@ -1295,7 +2657,7 @@ MemoryResults ProfilerApp::getMemoryResults()
     // Get the current memory usage
     if ( static_cast<int8_t>( d_store_memory_data ) >= 2 ) {
         auto thread = getThreadData();
-        int64_t ns  = diff_ns( std::chrono::steady_clock::now(), d_construct_time );
+        int64_t ns  = getTime();
         thread->memory.add( ns, d_store_memory_data, d_bytes );
     }
     // Get a lock
@@ -1454,11 +2816,331 @@ static void gatherMemory( std::vector<MemoryResults>& memory )
     }
     comm_barrier();
 }
+static std::vector<uint64_t> gatherStream( uint64_t bytes, int rank, int N_procs )
+{
+    // Gather the size of the stream on each rank (rank 0 gets all sizes)
+    std::vector<uint64_t> data( 1, bytes );
+    if ( rank == 0 ) {
+        data.resize( N_procs );
+        for ( int r = 1; r < N_procs; r++ )
+            data[r] = comm_recv2( r, 3 )[0];
+    } else {
+        comm_send2( data, 0, 3 );
+    }
+    return data;
+}
+
+
+/***********************************************************************
+ * Binary timer file                                                    *
+ ***********************************************************************/
+// The binary timer file (.x.tbin, see setSaveBinary) stores the header, the timer index, the
+// fixed-width trace records, the histograms, the slowest calls and the string table.  Each
+// section is 8 byte aligned and uses the byte order of the writer.
+struct BinaryHeader {
+    char magic[8];      // "TIMERBIN"
+    uint32_t version;   // Format version
+    uint32_t endian;    // BINARY_ENDIAN in the byte order of the writer
+    int32_t N_procs;    // Number of processors
+    int32_t rank;       // Rank that saved the file
+    uint32_t N_timers;  // Number of timers
+    uint32_t flags;     // Trace data stored (bit 0), memory data stored (bit 1)
+    uint64_t N_traces;  // Number of traces
+    uint64_t N_hist;    // Number of histograms
+    uint64_t N_slow;    // Number of slowest call arrays
+    uint64_t N_strings; // Size of the string table (bytes)
+    uint64_t timers;    // Offset of the timers (bytes)
+    uint64_t traces;    // Offset of the traces (bytes)
+    uint64_t hist;      // Offset of the histograms (bytes)
+    uint64_t slow;      // Offset of the slowest calls (bytes)
+    uint64_t strings;   // Offset of the string table (bytes)
+    double walltime;    // Total wallclock time (s)
+    double overhead;    // Measured cost of a start/stop pair (ns)
+    uint32_t date;      // Offset of the date in the string table
+    uint32_t reserved;  // Unused
+};
+struct BinaryTimer {
+    uint64_t id;      // Timer id
+    uint32_t message; // Offset of the message in the string table
+    uint32_t file;    // Offset of the filename in the string table
+    uint32_t path;    // Offset of the path in the string table
+    int32_t line;     // Line number
+    uint64_t trace;   // Index of the first trace
+    uint64_t N_trace; // Number of traces
+};
+struct BinaryTrace {
+    uint64_t N;        // Total number of calls
+    uint64_t N_timed;  // Number of calls that were timed
+    uint64_t N_child;  // Number of calls to child timers
+    uint64_t N_desc;   // Number of calls to all nested timers
+    uint64_t perf[4];  // Total performance counts for the calls
+    uint64_t stack;    // Hash value of the stack trace
+    uint64_t stack2;   // Hash value of the stack trace (including this call)
+    uint64_t hist;     // Index of the histogram (BINARY_NONE if not stored)
+    uint64_t slow;     // Index of the slowest calls (BINARY_NONE if not stored)
+    float min;         // Minimum call time (ns)
+    float max;         // Maximum call time (ns)
+    float tot;         // Total call time (ns)
+    float self;        // Total exclusive call time (ns)
+    float cpu;         // Total thread CPU time (ns)
+    float stdev;       // Standard deviation of the call times (ns)
+    uint32_t rank;     // Rank
+    uint16_t thread;   // Thread
+    uint8_t perf_set;  // Performance counters stored
+    uint8_t reserved;  // Unused
+};
+static_assert( sizeof( BinaryHeader ) == 128 && sizeof( BinaryTimer ) == 40 );
+static_assert( sizeof( BinaryTrace ) == 128 );
+static constexpr uint32_t BINARY_VERSION = 2;
+static constexpr uint32_t BINARY_ENDIAN  = 0x01020304;
+static constexpr uint64_t BINARY_NONE    = ~( (uint64_t) 0 );
+// 64-bit file positions (long is 32-bits on Windows)
+static inline int64_t ftell64( FILE* fid )
+{
+#if defined( _WIN32 )
+    return _ftelli64( fid );
+#else
+    return ftell( fid );
+#endif
+}
+static inline int fseek64( FILE* fid, int64_t offset, int origin )
+{
+#if defined( _WIN32 )
+    return _fseeki64( fid, offset, origin );
+#else
+    return fseek( fid, offset, origin );
+#endif
+}
+// Class to map a file to memory (read-only), reads the file if it cannot be mapped
+class MappedFile final
+{
+public:
+    explicit MappedFile( const std::string& filename )
+        : d_data( nullptr ), d_size( 0 ), d_mapped( false )
+    {
+#ifdef TIMER_ENABLE_MMAP
+        int fd = open( filename.data(), O_RDONLY );
+        if ( fd < 0 )
+            throw std::logic_error( "Error opening file: " + filename );
+        struct stat st;
+        if ( fstat( fd, &st ) == 0 && st.st_size > 0 ) {
+            d_size    = st.st_size;
+            void* ptr = mmap( nullptr, d_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+            d_mapped  = ptr != MAP_FAILED;
+            d_data    = d_mapped ? static_cast<const char*>( ptr ) : nullptr;
+        }
+        ::close( fd );
+        if ( d_mapped )
+            return;
+#endif
+        FILE* fid = fopen( filename.data(), "rb" );
+        if ( fid == nullptr )
+            throw std::logic_error( "Error opening file: " + filename );
+        int64_t size = fseek64( fid, 0, SEEK_END ) == 0 ? ftell64( fid ) : -1;
+        if ( size < 0 || static_cast<uint64_t>( size ) >= std::numeric_limits<size_t>::max() ) {
+            fclose( fid );
+            throw std::logic_error( "Error getting the size of file: " + filename );
+        }
+        d_size = size;
+        rewind( fid );
+        auto* buffer  = allocate<char>( d_size + 1 );
+        size_t result = fread( buffer, 1, d_size, fid );
+        fclose( fid );
+        d_data = buffer;
+        if ( result != d_size ) {
+            free( buffer );
+            throw std::logic_error( "error reading file" );
+        }
+    }
+    ~MappedFile()
+    {
+#ifdef TIMER_ENABLE_MMAP
+        if ( d_mapped ) {
+            munmap( const_cast<char*>( d_data ), d_size );
+            return;
+        }
+#endif
+        free( const_cast<char*>( d_data ) );
+    }
+    MappedFile( const MappedFile& )            = delete;
+    MappedFile& operator=( const MappedFile& ) = delete;
+    inline const char* data() const { return d_data; }
+    inline size_t size() const { return d_size; }
+
+private:
+    const char* d_data;
+    size_t d_size;
+    bool d_mapped;
+};
+static void saveBinary( const char* filename, const std::vector<TimerResults>& results,
+    const std::vector<size_t>& id_order, const std::string& date, BinaryHeader header )
+{
+    // Build the string table (identical strings are stored once)
+    std::string strings;
+    std::map<std::string, uint32_t> string_map;
+    auto addString = [&strings, &string_map]( const std::string& str ) {
+        auto it = string_map.find( str );
+        if ( it != string_map.end() )
+            return it->second;
+        auto offset = static_cast<uint32_t>( strings.size() );
+        strings.append( str.data(), str.size() + 1 );
+        string_map[str] = offset;
+        return offset;
+    };
+    header.date = addString( date );
+    // Create the timer and trace records, storing the most expensive timer first
+    std::vector<BinaryTimer> timers( results.size() );
+    std::vector<BinaryTrace> traces;
+    std::vector<uint64_t> hist;
+    std::vector<uint64_t> slow;
+    for ( size_t ii = 0; ii < results.size(); ii++ ) {
+        const auto& timer = results[id_order[results.size() - 1 - ii]];
+        auto& timer2      = timers[ii];
+        timer2.id         = timer.id;
+        timer2.message    = addString( timer.message );
+        timer2.file       = addString( timer.file );
+        timer2.path       = addString( timer.path );
+        timer2.line       = timer.line;
+        timer2.trace      = traces.size();
+        timer2.N_trace    = timer.trace.size();
+        for ( const auto& trace : timer.trace ) {
+            BinaryTrace trace2;
+            memset( &trace2, 0, sizeof( trace2 ) );
+            trace2.N        = trace.N;
+            trace2.N_timed  = trace.N_timed;
+            trace2.N_child  = trace.N_child;
+            trace2.N_desc   = trace.N_desc;
+            trace2.stack    = trace.stack;
+            trace2.stack2   = trace.stack2;
+            trace2.hist     = BINARY_NONE;
+            trace2.slow     = BINARY_NONE;
+            trace2.min      = trace.min;
+            trace2.max      = trace.max;
+            trace2.tot      = trace.tot;
+            trace2.self     = trace.self;
+            trace2.cpu      = trace.cpu;
+            trace2.stdev    = trace.stdev;
+            trace2.rank     = trace.rank;
+            trace2.thread   = trace.thread;
+            trace2.perf_set = trace.perf_set;
+            for ( int j = 0; j < 4; j++ )
+                trace2.perf[j] = trace.perf[j];
+            if ( trace.hist ) {
+                trace2.hist = hist.size() / TraceResults::HIST_SIZE;
+                hist.insert( hist.end(), trace.hist, trace.hist + TraceResults::HIST_SIZE );
+            }
+            if ( trace.slow ) {
+                trace2.slow = slow.size() / ( 2 * TraceResults::SLOW_SIZE );
+                slow.insert( slow.end(), trace.slow, trace.slow + 2 * TraceResults::SLOW_SIZE );
+            }
+            traces.push_back( trace2 );
+        }
+    }
+    // Set the section sizes and offsets
+    memcpy( header.magic, "TIMERBIN", 8 );
+    header.version   = BINARY_VERSION;
+    header.endian    = BINARY_ENDIAN;
+    header.N_timers  = timers.size();
+    header.N_traces  = traces.size();
+    header.N_hist    = hist.size() / TraceResults::HIST_SIZE;
+    header.N_slow    = slow.size() / ( 2 * TraceResults::SLOW_SIZE );
+    header.N_strings = strings.size();
+    header.timers    = sizeof( BinaryHeader );
+    header.traces    = header.timers + timers.size() * sizeof( BinaryTimer );
+    header.hist      = header.traces + traces.size() * sizeof( BinaryTrace );
+    header.slow      = header.hist + hist.size() * sizeof( uint64_t );
+    header.strings   = header.slow + slow.size() * sizeof( uint64_t );
+    // Write the file
+    FILE* fid = fopen( filename, "wb" );
+    if ( fid == nullptr ) {
+        std::cerr << "Error opening file for writing (binary timer)";
+        return;
+    }
+    fwrite( &header, sizeof( header ), 1, fid );
+    fwrite( timers.data(), sizeof( BinaryTimer ), timers.size(), fid );
+    fwrite( traces.data(), sizeof( BinaryTrace ), traces.size(), fid );
+    fwrite( hist.data(), sizeof( uint64_t ), hist.size(), fid );
+    fwrite( slow.data(), sizeof( uint64_t ), slow.size(), fid );
+    fwrite( strings.data(), 1, strings.size(), fid );
+    fclose( fid );
+}
 
 
 /***********************************************************************
  * Function to save the profiling info                                  *
  ***********************************************************************/
+static void saveText( FILE* fid, const TimerResults& timer )
+{
+    // Store the basic timer info
+    const char e = 0x0E; // Escape character for printing strings
+    fprintf( fid, "<timer:id=%s,message=%c%s%c,file=%c%s%c,path=%c%s%c,line=%i>\n",
+        timer.id.str().data(), e, timer.message, e, e, timer.file, e, e, timer.path, e,
+        timer.line );
+    // Store the trace data
+    for ( const auto& trace : timer.trace ) {
+        unsigned long N       = trace.N;
+        unsigned long N_child = trace.N_child;
+        unsigned long N_desc  = trace.N_desc;
+        char optional[256]    = { 0 };
+        int pos               = 0;
+        if ( trace.cpu >= 0 ) {
+            // Store the thread CPU time
+            pos += snprintf( &optional[pos], 32, ",cpu=%e", 1e-9 * trace.cpu );
+        }
+        if ( trace.stdev >= 0 ) {
+            // Store the standard deviation
+            pos += snprintf( &optional[pos], 32, ",std=%e", 1e-9 * trace.stdev );
+        }
+        if ( trace.N_timed != trace.N ) {
+            // The trace was throttled, record the number of timed calls
+            unsigned long N_timed = trace.N_timed;
+            pos += snprintf( &optional[pos], 32, ",N_timed=%lu", N_timed );
+        }
+        if ( trace.perf_set != 0 ) {
+            // Store the performance counters
+            const char* name = trace.perf_set == 1 ? "hw" : "sw";
+            unsigned long x[4];
+            for ( int j = 0; j < 4; j++ )
+                x[j] = trace.perf[j];
+            pos += snprintf(
+                &optional[pos], 96, ",%s=[%lu;%lu;%lu;%lu]", name, x[0], x[1], x[2], x[3] );
+        }
+        std::string hist;
+        if ( trace.hist ) {
+            // Store the non-zero bins of the histogram
+            hist = ",hist=[";
+            for ( int j = 0; j < TraceResults::HIST_SIZE; j++ ) {
+                if ( trace.hist[j] != 0 )
+                    hist += std::to_string( j ) + ':' + std::to_string( trace.hist[j] ) + ';';
+            }
+            if ( hist.back() == ';' )
+                hist.back() = ']';
+            else
+                hist += ']';
+        }
+        std::string slow;
+        if ( trace.slow ) {
+            // Store the start time and duration of the slowest calls (ns)
+            slow = ",slow=[";
+            for ( int j = 0; j < TraceResults::SLOW_SIZE; j++ ) {
+                if ( trace.slow[2 * j + 1] != 0 )
+                    slow += std::to_string( trace.slow[2 * j] ) + ':' +
+                            std::to_string( trace.slow[2 * j + 1] ) + ';';
+            }
+            if ( slow.back() == ';' )
+                slow.back() = ']';
+            else
+                slow += ']';
+        }
+        fprintf( fid,
+            "<trace:id=%s,thread=%u,rank=%u,N=%lu,min=%e,max=%e,tot=%e,self=%e,"
+            "tot_corr=%e,self_corr=%e,N_child=%lu,N_desc=%lu%s%s%s,stack=[%s;%s]>\n",
+            trace.id.str().data(), trace.thread, trace.rank, N, 1e-9 * trace.min, 1e-9 * trace.max,
+            1e-9 * trace.tot, 1e-9 * trace.self, 1e-9 * trace.totCorrected(),
+            1e-9 * trace.selfCorrected(), N_child, N_desc, optional, hist.c_str(), slow.c_str(),
+            hash_to_str( trace.stack ).data(), hash_to_str( trace.stack2 ).data() );
+    }
+}
 static bool isRecursive( const TimerResults& timer, const TraceResults& trace,
     const std::vector<uint64_t>& stackIDs, const std::vector<std::vector<uint64_t>>& stackList )
 {
@@ -1470,30 +3152,42 @@ static bool isRecursive( const TimerResults& timer, const TraceResults& trace,
     return found;
 };
 void ProfilerApp::save( const std::string& filename, bool global )
+{
+    save( filename, global, comm_rank(), comm_size() );
+}
+void ProfilerApp::save( const std::string& filename, bool global, int rank, int N_procs )
 {
     if ( d_level < 0 ) {
         std::cout << "Warning: Timers are not enabled, no data will be saved\n";
         return;
     }
-    const int N_procs = comm_size();
-    const int rank    = comm_rank();
     // Set the filenames
-    char filename_timer[1000], filename_trace[1000], filename_memory[1000];
+    char filename_timer[1000], filename_trace[1000], filename_memory[1000], filename_binary[1000];
     if ( !global ) {
         sprintf( filename_timer, "%s.%i.timer", filename.c_str(), rank + 1 );
         sprintf( filename_trace, "%s.%i.trace", filename.c_str(), rank + 1 );
         sprintf( filename_memory, "%s.%i.memory", filename.c_str(), rank + 1 );
+        sprintf( filename_binary, "%s.%i.tbin", filename.c_str(), rank + 1 );
     } else {
         sprintf( filename_timer, "%s.0.timer", filename.c_str() );
         sprintf( filename_trace, "%s.0.trace", filename.c_str() );
         sprintf( filename_memory, "%s.0.memory", filename.c_str() );
+        sprintf( filename_binary, "%s.0.tbin", filename.c_str() );
     }
     // Get the current results
-    double walltime = 1e-9 * diff_ns( std::chrono::steady_clock::now(), d_construct_time );
-    auto results    = getTimerResults();
+    double walltime = 1e-9 * getTime();
+    auto results    = getTimerResults( rank );
+    bool stream     = d_stream.active();
+    std::vector<uint64_t> stream_bytes;
+    if ( stream ) {
+        // The calls removed from memory before the results were copied must be on disk
+        stream_bytes.push_back( d_stream.flush() );
+    }
     if ( global ) {
         // Gather the timers from all files (rank 0 will do all writing)
         gatherTimers( results );
+        uint64_t bytes = stream ? stream_bytes[0] : 0;
+        stream_bytes   = gatherStream( bytes, rank, N_procs );
     }
     int N_threads = 0;
     for ( auto& timer : results ) {
@@ -1525,25 +3219,38 @@ void ProfilerApp::save( const std::string& filename, bool global )
             std::cerr << "Error opening file for writing (timer)";
             return;
         }
+        bool store_trace = stream;
+        for ( auto it = results.begin(); it != results.end() && !store_trace; ++it ) {
+            for ( auto& trace : it->trace )
+                store_trace = store_trace || trace.times;
+        }
         FILE* traceFile = nullptr;
-        for ( auto it = results.begin(); it != results.end() && !traceFile; ++it ) {
-            for ( auto& trace : it->trace ) {
-                if ( trace.times ) {
-                    traceFile = fopen( filename_trace, "wb" );
-                    if ( traceFile == nullptr ) {
-                        std::cerr << "Error opening file for writing (trace)";
-                        fclose( timerFile );
-                        return;
-                    }
-                    break;
-                }
+        if ( store_trace ) {
+            traceFile = fopen( filename_trace, "wb" );
+            if ( traceFile == nullptr ) {
+                std::cerr << "Error opening file for writing (trace)";
+                fclose( timerFile );
+                return;
             }
         }
+        if ( stream ) {
+            // The remaining calls are in the stream (see loadStream), we store the size of
+            //    the stream for each rank so the calls streamed after this save are ignored
+            std::string bytes;
+            for ( size_t r = 0; r < stream_bytes.size(); r++ ) {
+                bytes += bytes.empty() ? '[' : ';';
+                bytes += std::to_string( global ? r : rank ) + ':';
+                bytes += std::to_string( stream_bytes[r] );
+            }
+            fprintf( traceFile, "<stream=%s,bytes=%s]>\n", d_stream.prefix().data(), bytes.data() );
+        }
         // Create the file header
         char header[] = "                  Message                      Filename           Line"
-                        "   Thread    N_calls   Min Time  Max Time  Total Time  %% Time\n"
+                        "   Thread    N_calls   Min Time  Max Time  Total Time   Self Time"
+                        "  Total Corr   Self Corr  %% Time\n"
                         "---------------------------------------------------------------------"
-                        "---------------------------------------------------------------\n";
+                        "---------------------------------------------------------------"
+                        "------------------------------------\n";
         fprintf( timerFile, "%s", header );
         // Loop through the list of timers, storing the most expensive first
         std::vector<uint64_t> stack2;
@@ -1557,13 +3264,20 @@ void ProfilerApp::save( const std::string& filename, bool global )
             std::vector<double> min_thread( N_threads, 1e99 );
             std::vector<double> max_thread( N_threads, 0.0 );
             std::vector<double> tot_thread( N_threads, 0.0 );
+            std::vector<double> self_thread( N_threads, 0.0 );
+            std::vector<double> tot_corr_thread( N_threads, 0.0 );
+            std::vector<double> self_corr_thread( N_threads, 0.0 );
             for ( auto& trace : results[i].trace ) {
                 int k = trace.thread;
                 N_thread[k] += trace.N;
                 min_thread[k] = std::min( min_thread[k], 1e-9 * trace.min );
                 max_thread[k] = std::max( max_thread[k], 1e-9 * trace.max );
-                if ( !isRecursive( results[i], trace, stackIDs, stackList ) )
+                if ( !isRecursive( results[i], trace, stackIDs, stackList ) ) {
                     tot_thread[k] += 1e-9 * trace.tot;
+                    tot_corr_thread[k] += 1e-9 * trace.totCorrected();
+                }
+                self_thread[k] += 1e-9 * trace.self;
+                self_corr_thread[k] += 1e-9 * trace.selfCorrected();
             }
             for ( int j = 0; j < N_threads; j++ ) {
                 if ( N_thread[j] == 0 )
@@ -1573,41 +3287,40 @@ void ProfilerApp::save( const std::string& filename, bool global )
                 // Note: we always want one space in front in case the timer starts
                 //    with '<' and is long.
                 fprintf( timerFile,
-                    " %29s  %30s   %5i   %5i    %8i   %8.3f  %8.3f  %10.3f  %6.1f\n",
+                    " %29s  %30s   %5i   %5i    %8i   %8.3f  %8.3f  %10.3f  %10.3f  %10.3f  "
+                    "%10.3f  %6.1f\n",
                     results[i].message, results[i].file, results[i].line, j, N_thread[j],
-                    min_thread[j], max_thread[j], tot_thread[j], percentage );
+                    min_thread[j], max_thread[j], tot_thread[j], self_thread[j],
+                    tot_corr_thread[j], self_corr_thread[j], percentage );
             }
         }
         // Loop through all of the entries, saving the detailed data and the trace logs
+        auto date = getDateString();
         fprintf( timerFile, "\n\n\n" );
         fprintf( timerFile, "<N_procs=%i,id=%i", N_procs, rank );
         fprintf( timerFile, ",store_trace=%i", traceFile ? 1 : 0 );
         fprintf( timerFile, ",store_memory=%i", d_store_memory_data != MemoryLevel::None ? 1 : 0 );
         fprintf( timerFile, ",walltime=%e", walltime );
-        fprintf( timerFile, ",date='%s'>\n", getDateString().c_str() );
+        fprintf( timerFile, ",overhead=%e", 1e-9 * d_overhead );
+        if ( d_save_binary )
+            fprintf( timerFile, ",format=binary" );
+        fprintf( timerFile, ",date='%s'>\n", date.c_str() );
         // Loop through the list of timers, storing the most expensive first
         for ( int ii = static_cast<int>( results.size() ) - 1; ii >= 0; ii-- ) {
             size_t i = id_order[ii];
-            // Store the basic timer info
-            const char e = 0x0E; // Escape character for printing strings
-            fprintf( timerFile, "<timer:id=%s,message=%c%s%c,file=%c%s%c,path=%c%s%c,line=%i>\n",
-                results[i].id.str().data(), e, results[i].message, e, e, results[i].file, e, e,
-                results[i].path, e, results[i].line );
-            // Store the trace data
+            // Store the timer and trace records (the binary records are saved below)
+            if ( !d_save_binary )
+                saveText( timerFile, results[i] );
             for ( const auto& trace : results[i].trace ) {
-                unsigned long N = trace.N;
-                fprintf( timerFile,
-                    "<trace:id=%s,thread=%u,rank=%u,N=%lu,min=%e,max=%e,tot=%e,stack=[%s;%s]>\n",
-                    trace.id.str().data(), trace.thread, trace.rank, N, 1e-9 * trace.min,
-                    1e-9 * trace.max, 1e-9 * trace.tot, hash_to_str( trace.stack ).data(),
-                    hash_to_str( trace.stack2 ).data() );
                 // Save the detailed trace results (this is a binary file)
                 if ( trace.N_trace > 0 ) {
-                    unsigned long Nt = trace.N_trace;
-                    fprintf( traceFile, "<id=%s,thread=%u,rank=%u,stack=%s,N=%lu,format=uint16f>\n",
+                    unsigned long Nt     = trace.N_trace;
+                    unsigned long length = sizeLEB128( trace.times, 2 * Nt );
+                    fprintf( traceFile,
+                        "<id=%s,thread=%u,rank=%u,stack=%s,N=%lu,bytes=%lu,format=leb128>\n",
                         trace.id.str().data(), trace.thread, trace.rank,
-                        hash_to_str( trace.stack ).data(), Nt );
-                    fwrite( trace.times, sizeof( uint16f ), 2 * Nt, traceFile );
+                        hash_to_str( trace.stack ).data(), Nt, length );
+                    fwrite( trace.times, 1, length, traceFile );
                     fprintf( traceFile, "\n" );
                 }
             }
@@ -1616,6 +3329,18 @@ void ProfilerApp::save( const std::string& filename, bool global )
         fclose( timerFile );
         if ( traceFile != nullptr )
             fclose( traceFile );
+        if ( d_save_binary ) {
+            // Save the timer and trace records
+            BinaryHeader header;
+            memset( &header, 0, sizeof( header ) );
+            bool memory     = d_store_memory_data != MemoryLevel::None;
+            header.N_procs  = N_procs;
+            header.rank     = rank;
+            header.flags    = ( traceFile ? 1 : 0 ) | ( memory ? 2 : 0 );
+            header.walltime = walltime;
+            header.overhead = d_overhead;
+            saveBinary( filename_binary, results, id_order, date, header );
+        }
     }
     results.clear();
     // Store the memory trace info
@@ -1683,6 +3408,78 @@ void ProfilerApp::save( const std::string& filename, bool global )
 }
 
 
+/***********************************************************************
+ * Periodically save the results from a background thread               *
+ * Note: Each snapshot is a complete save to filename.<seq> and we      *
+ *   remove the oldest snapshot after the new one is written, so a      *
+ *   crash loses at most one interval.  The rank is cached when the     *
+ *   thread is started so the snapshots do not call MPI (which is not   *
+ *   safe from another thread without MPI_THREAD_MULTIPLE).             *
+ ***********************************************************************/
+class AutoSave final
+{
+public:
+    AutoSave() : d_stop( false ) {}
+    ~AutoSave() { stop(); }
+    using SaveFun = void ( * )( const std::string&, bool, int, int );
+    void start( const std::string& filename, double interval, int keep, int rank, int N_procs,
+        SaveFun save )
+    {
+        d_thread =
+            std::thread( &AutoSave::run, this, filename, interval, keep, rank, N_procs, save );
+    }
+    void stop()
+    {
+        if ( !d_thread.joinable() || d_thread.get_id() == std::this_thread::get_id() )
+            return;
+        d_mutex.lock();
+        d_stop = true;
+        d_mutex.unlock();
+        d_wake.notify_all();
+        d_thread.join();
+        d_stop = false;
+    }
+
+private:
+    void run( const std::string& filename, double interval, int keep, int rank, int N_procs,
+        SaveFun save )
+    {
+        const std::chrono::duration<double> wait( interval );
+        std::unique_lock<std::mutex> lock( d_mutex );
+        int seq = 0;
+        while ( !d_wake.wait_for( lock, wait, [this] { return d_stop; } ) ) {
+            if ( ProfilerApp::getLevel() < 0 )
+                continue;
+            lock.unlock();
+            seq++;
+            save( filename + "." + std::to_string( seq ), false, rank, N_procs );
+            if ( seq > keep ) {
+                auto prefix = filename + "." + std::to_string( seq - keep ) + ".";
+                prefix += std::to_string( rank + 1 );
+                remove( ( prefix + ".timer" ).data() );
+                remove( ( prefix + ".trace" ).data() );
+                remove( ( prefix + ".memory" ).data() );
+                remove( ( prefix + ".tbin" ).data() );
+            }
+            lock.lock();
+        }
+    }
+    bool d_stop;
+    std::mutex d_mutex;
+    std::condition_variable d_wake;
+    std::thread d_thread;
+};
+static AutoSave d_autosave;
+void ProfilerApp::setAutoSave( const std::string& filename, double interval, int keep )
+{
+    if ( keep < 1 )
+        throw std::logic_error( "At least one snapshot must be kept" );
+    d_autosave.stop();
+    if ( !filename.empty() && interval > 0 )
+        d_autosave.start( filename, interval, keep, comm_rank(), comm_size(), &save );
+}
+
+
 /***********************************************************************
  * Load the timer and trace data                                        *
  ***********************************************************************/
@@ -1734,21 +3531,21 @@ static inline T convert( std::string_view field )
         static_assert( !std::is_same_v<T, T> );
     }
 }
-static size_t getFieldArray(
-    const char* line0, std::vector<std::pair<std::string_view, std::string_view>>& data )
+static size_t getFieldArray( const char* line0, const char* end,
+    std::vector<std::pair<std::string_view, std::string_view>>& data )
 {
     // This function parses a line of the form <field=value,field=value>
     const char e = 0x0E; // Escape character for printing strings
-    // Find the line of interest
+    // Find the line of interest (the line may not be null terminated)
     ASSERT( line0[0] == '<' );
     int count = 0;
     size_t i0 = 0;
-    while ( ( line0[i0] != '>' || count % 2 == 1 ) && line0[i0] != 0 ) {
+    while ( line0 + i0 < end && ( line0[i0] != '>' || count % 2 == 1 ) && line0[i0] != 0 ) {
         if ( line0[i0] == e )
             count++;
         i0++;
     }
-    ASSERT( line0[i0] == '>' );
+    ASSERT( line0 + i0 < end && line0[i0] == '>' );
     std::string_view line( &line0[1], i0 - 1 );
     data.clear();
     while ( true ) {
@@ -1800,6 +3597,49 @@ static std::tuple<id_struct, id_struct> loadActive( std::string_view str, id_str
     id_struct stack2( stack ^ static_cast<uint64_t>( id ) );
     return std::make_tuple( stack1, stack2 );
 }
+static uint64_t* loadHistogram( std::string_view str )
+{
+    ASSERT( str.size() >= 2 && str[0] == '[' && str.back() == ']' );
+    str        = str.substr( 1, str.size() - 2 );
+    auto* hist = allocate<uint64_t>( TraceResults::HIST_SIZE );
+    memset( hist, 0, TraceResults::HIST_SIZE * sizeof( uint64_t ) );
+    while ( !str.empty() ) {
+        size_t i = str.find( ':' );
+        size_t j = std::min( str.find( ';' ), str.size() );
+        ASSERT( i < j );
+        int bin = convert<int>( str.substr( 0, i ) );
+        ASSERT( bin >= 0 && bin < TraceResults::HIST_SIZE );
+        hist[bin] = convert<uint64_t>( str.substr( i + 1, j - i - 1 ) );
+        str       = str.substr( std::min( j + 1, str.size() ) );
+    }
+    return hist;
+}
+static uint64_t* loadSlowest( std::string_view str )
+{
+    ASSERT( str.size() >= 2 && str[0] == '[' && str.back() == ']' );
+    str        = str.substr( 1, str.size() - 2 );
+    auto* slow = allocate<uint64_t>( 2 * TraceResults::SLOW_SIZE );
+    memset( slow, 0, 2 * TraceResults::SLOW_SIZE * sizeof( uint64_t ) );
+    for ( int k = 0; !str.empty(); k++ ) {
+        size_t i = str.find( ':' );
+        size_t j = std::min( str.find( ';' ), str.size() );
+        ASSERT( i < j && k < TraceResults::SLOW_SIZE );
+        slow[2 * k]     = convert<uint64_t>( str.substr( 0, i ) );
+        slow[2 * k + 1] = convert<uint64_t>( str.substr( i + 1, j - i - 1 ) );
+        str             = str.substr( std::min( j + 1, str.size() ) );
+    }
+    return slow;
+}
+static void loadCounters( std::string_view str, uint64_t* x )
+{
+    ASSERT( str.size() >= 2 && str[0] == '[' && str.back() == ']' );
+    str = str.substr( 1, str.size() - 2 );
+    for ( int i = 0; i < 4; i++ ) {
+        size_t j = std::min( str.find( ';' ), str.size() );
+        x[i]     = convert<uint64_t>( str.substr( 0, j ) );
+        str      = str.substr( std::min( j + 1, str.size() ) );
+    }
+}
 template<class TYPE>
 static inline void keepRank( std::vector<TYPE>& data, int rank )
 {
@@ -1817,30 +3657,113 @@ static inline void copyText( char* out, std::string_view in, size_t N )
     memset( out, 0, N );
     strncpy( out, in.data(), std::min( N - 1, in.size() ) );
 }
+static void loadTimerBinary( const std::string& filename, std::vector<TimerResults>& data )
+{
+    // Map the file and check the header
+    MappedFile file( filename );
+    BinaryHeader header;
+    if ( file.size() < sizeof( header ) )
+        throw std::logic_error( "Invalid binary timer file: " + filename );
+    memcpy( &header, file.data(), sizeof( header ) );
+    if ( memcmp( header.magic, "TIMERBIN", 8 ) != 0 || header.endian != BINARY_ENDIAN )
+        throw std::logic_error( "Invalid binary timer file: " + filename );
+    if ( header.version != BINARY_VERSION )
+        throw std::logic_error( "Unsupported binary timer version: " + filename );
+    auto check = [&file, &filename]( uint64_t offset, uint64_t bytes ) {
+        if ( offset % 8 != 0 || offset + bytes > file.size() )
+            throw std::logic_error( "Invalid binary timer file: " + filename );
+    };
+    check( header.timers, header.N_timers * sizeof( BinaryTimer ) );
+    check( header.traces, header.N_traces * sizeof( BinaryTrace ) );
+    check( header.hist, header.N_hist * TraceResults::HIST_SIZE * sizeof( uint64_t ) );
+    check( header.slow, header.N_slow * 2 * TraceResults::SLOW_SIZE * sizeof( uint64_t ) );
+    check( header.strings, header.N_strings );
+    auto timers  = reinterpret_cast<const BinaryTimer*>( file.data() + header.timers );
+    auto traces  = reinterpret_cast<const BinaryTrace*>( file.data() + header.traces );
+    auto hist    = reinterpret_cast<const uint64_t*>( file.data() + header.hist );
+    auto slow    = reinterpret_cast<const uint64_t*>( file.data() + header.slow );
+    auto strings = file.data() + header.strings;
+    if ( header.N_strings == 0 || strings[header.N_strings - 1] != 0 )
+        throw std::logic_error( "Invalid binary timer file: " + filename );
+    auto getString = [&]( uint32_t offset ) {
+        if ( offset >= header.N_strings )
+            throw std::logic_error( "Invalid binary timer file: " + filename );
+        return std::string_view( strings + offset );
+    };
+    // Create a map of the ids and indicies of the timers (used for searching)
+    std::map<id_struct, size_t> id_map;
+    for ( size_t i = 0; i < data.size(); i++ )
+        id_map.insert( std::pair<id_struct, size_t>( data[i].id, i ) );
+    // Copy the timers and traces
+    data.reserve( data.size() + header.N_timers );
+    for ( size_t i = 0; i < header.N_timers; i++ ) {
+        const auto& timer2 = timers[i];
+        if ( timer2.trace + timer2.N_trace > header.N_traces )
+            throw std::logic_error( "Invalid binary timer file: " + filename );
+        id_struct id( timer2.id );
+        auto it = id_map.find( id );
+        if ( it == id_map.end() ) {
+            // Create a new timer
+            it = id_map.insert( std::pair<id_struct, size_t>( id, data.size() ) ).first;
+            data.resize( data.size() + 1 );
+            TimerResults& timer = data.back();
+            timer.id            = id;
+            timer.line          = timer2.line;
+            copyText( timer.message, getString( timer2.message ), sizeof( timer.message ) );
+            copyText( timer.file, getString( timer2.file ), sizeof( timer.file ) );
+            copyText( timer.path, getString( timer2.path ), sizeof( timer.path ) );
+        }
+        auto& timer = data[it->second];
+        timer.trace.reserve( timer.trace.size() + timer2.N_trace );
+        for ( size_t j = timer2.trace; j < timer2.trace + timer2.N_trace; j++ ) {
+            const auto& trace2 = traces[j];
+            timer.trace.resize( timer.trace.size() + 1 );
+            TraceResults& trace = timer.trace.back();
+            trace.id            = id;
+            trace.thread        = trace2.thread;
+            trace.rank          = trace2.rank;
+            trace.min           = trace2.min;
+            trace.max           = trace2.max;
+            trace.tot           = trace2.tot;
+            trace.self          = trace2.self;
+            trace.cpu           = trace2.cpu;
+            trace.stdev         = trace2.stdev;
+            trace.overhead      = header.overhead;
+            trace.N             = trace2.N;
+            trace.N_timed       = trace2.N_timed;
+            trace.N_child       = trace2.N_child;
+            trace.N_desc        = trace2.N_desc;
+            trace.perf_set      = trace2.perf_set;
+            trace.stack         = trace2.stack;
+            trace.stack2        = trace2.stack2;
+            for ( int k = 0; k < 4; k++ )
+                trace.perf[k] = trace2.perf[k];
+            if ( trace2.hist != BINARY_NONE ) {
+                // Copy the histogram of the call times
+                if ( trace2.hist >= header.N_hist )
+                    throw std::logic_error( "Invalid binary timer file: " + filename );
+                trace.hist = allocate<uint64_t>( TraceResults::HIST_SIZE );
+                memcpy( trace.hist, &hist[trace2.hist * TraceResults::HIST_SIZE],
+                    TraceResults::HIST_SIZE * sizeof( uint64_t ) );
+            }
+            if ( trace2.slow != BINARY_NONE ) {
+                // Copy the slowest calls
+                if ( trace2.slow >= header.N_slow )
+                    throw std::logic_error( "Invalid binary timer file: " + filename );
+                trace.slow = allocate<uint64_t>( 2 * TraceResults::SLOW_SIZE );
+                memcpy( trace.slow, &slow[2 * trace2.slow * TraceResults::SLOW_SIZE],
+                    2 * TraceResults::SLOW_SIZE * sizeof( uint64_t ) );
+            }
+        }
+    }
+}
 static void loadTimer( const std::string& filename, std::vector<TimerResults>& data, int& N_procs,
     double& walltime, std::string& date, bool& trace_data, bool& memory_data )
 {
-    // Load the file to memory for reading
-    FILE* fid = fopen( filename.c_str(), "rb" );
-    if ( fid == nullptr )
-        throw std::logic_error( "Error opening file: " + filename );
-    fseek( fid, 0, SEEK_END );
-    size_t file_length = ftell( fid );
-    if ( file_length > 0x80000000 ) {
-        // We do not yet support large files, we need to read the data in chunks
-        fclose( fid );
-        throw std::logic_error( "Large timer files are not yet supported (likely to exhaust ram)" );
-    }
-    auto* buffer = new char[file_length + 10];
-    memset( buffer, 0, file_length + 10 );
-    rewind( fid );
-    size_t result = fread( buffer, 1, file_length, fid );
-    if ( result != file_length ) {
-        delete[] buffer;
-        fclose( fid );
-        throw std::logic_error( "error reading file" );
-    }
-    fclose( fid );
+    // Map the file to memory for reading (the records are parsed in place)
+    MappedFile file( filename );
+    const char* buffer = file.data();
+    const char* end    = buffer + file.size();
     // Create a map of the ids and indicies of the timers (used for searching)
     std::map<id_struct, size_t> id_map;
     for ( size_t i = 0; i < data.size(); i++ )
@@ -1848,24 +3771,26 @@ static void loadTimer( const std::string& filename, std::vector<TimerResults>& d
     // Parse the data (this take most of the time)
     N_procs     = -1;
     int rank    = -1;
+    float cost  = 0;
+    bool binary = false;
     walltime    = -1;
     trace_data  = false;
     memory_data = false;
     date        = std::string();
     std::vector<std::pair<std::string_view, std::string_view>> fields;
     std::vector<id_struct> active;
-    char* line = buffer;
-    while ( line < buffer + file_length ) {
+    const char* line = buffer;
+    while ( line < end ) {
         // Check if we are reading a dummy (human-readable) line
         if ( line[0] != '<' ) {
-            while ( *line >= 32 ) {
+            while ( line < end && *line >= 32 ) {
                 line++;
             }
             line++;
             continue;
         }
         // Read the next line and split the fields
-        line += getFieldArray( line, fields );
+        line += getFieldArray( line, end, fields );
         if ( fields[0].first == "N_procs" ) {
             // We are loading the header
             N_procs = convert<int>( fields[0].second );
@@ -1883,9 +3808,15 @@ static void loadTimer( const std::string& filename, std::vector<TimerResults>& d
                 } else if ( fields[i].first == "walltime" ) {
                     // Check if we stored the total wallclock time
                     walltime = convert<double>( fields[i].second );
+                } else if ( fields[i].first == "overhead" ) {
+                    // Load the cost of a start/stop pair (optional)
+                    cost = 1e9 * convert<double>( fields[i].second );
                 } else if ( fields[i].first == "date" ) {
                     // Load the date (optional)
                     date = std::string( fields[i].second );
+                } else if ( fields[i].first == "format" ) {
+                    // Check if the records are stored in the binary file (optional)
+                    binary = fields[i].second == "binary";
                 } else {
                     throw std::logic_error(
                         "Unknown field (header): " + std::string( fields[i].first ) );
@@ -1942,6 +3873,7 @@ static void loadTimer( const std::string& filename, std::vector<TimerResults>& d
             trace.id            = id;
             trace.N_trace       = 0;
             trace.rank          = rank;
+            trace.overhead      = cost;
             // Load the remaining fields
             for ( size_t i = 1; i < fields.size(); i++ ) {
                 if ( fields[i].first == "thread" ) {
@@ -1962,6 +3894,36 @@ static void loadTimer( const std::string& filename, std::vector<TimerResults>& d
                 } else if ( fields[i].first == "tot" ) {
                     // Load tot
                     trace.tot = 1e9 * convert<double>( fields[i].second );
+                } else if ( fields[i].first == "self" ) {
+                    // Load the exclusive time (optional)
+                    trace.self = 1e9 * convert<double>( fields[i].second );
+                } else if ( fields[i].first == "std" ) {
+                    // Load the standard deviation (optional)
+                    trace.stdev = 1e9 * convert<double>( fields[i].second );
+                } else if ( fields[i].first == "cpu" ) {
+                    // Load the thread CPU time (optional)
+                    trace.cpu = 1e9 * convert<double>( fields[i].second );
+                } else if ( fields[i].first == "hw" || fields[i].first == "sw" ) {
+                    // Load the performance counters (optional)
+                    trace.perf_set = fields[i].first == "hw" ? 1 : 2;
+                    loadCounters( fields[i].second, trace.perf );
+                } else if ( fields[i].first == "hist" ) {
+                    // Load the histogram of the call times (optional)
+                    trace.hist = loadHistogram( fields[i].second );
+                } else if ( fields[i].first == "slow" ) {
+                    // Load the slowest calls (optional)
+                    trace.slow = loadSlowest( fields[i].second );
+                } else if ( fields[i].first == "N_timed" ) {
+                    // Load the number of timed calls (optional, throttled traces)
+                    trace.N_timed = convert<uint64_t>( fields[i].second );
+                } else if ( fields[i].first == "tot_corr" || fields[i].first == "self_corr" ) {
+                    // The corrected times are computed from the overhead (see totCorrected)
+                } else if ( fields[i].first == "N_child" ) {
+                    // Load the number of calls to child timers (optional)
+                    trace.N_child = convert<uint64_t>( fields[i].second );
+                } else if ( fields[i].first == "N_desc" ) {
+                    // Load the number of calls to nested timers (optional)
+                    trace.N_desc = convert<uint64_t>( fields[i].second );
                 } else if ( fields[i].first == "stack" ) {
                     // Load stack
                     auto i1 = fields[i].second.find( '[' );
@@ -1983,21 +3945,118 @@ static void loadTimer( const std::string& filename, std::vector<TimerResults>& d
                         "Unknown field (trace): " + std::string( fields[i].first ) );
                 }
             }
+            if ( trace.N_timed == 0 )
+                trace.N_timed = trace.N; // Every call was timed
         } else {
             throw std::logic_error( "Unknown data field: " + std::string( fields[0].first ) );
         }
     }
-    // Fill walltime with largest timer (if it does not exist for backward compatibility)
-    if ( walltime < 0 ) {
-        walltime = 0;
-        for ( const auto& timer : data ) {
-            for ( const auto& trace : timer.trace )
-                walltime = std::max( walltime, 1e-9 * trace.tot );
+    if ( binary ) {
+        // Load the timer and trace records from the binary file (.x.tbin)
+        loadTimerBinary( filename.substr( 0, filename.size() - 5 ) + "tbin", data );
+    }
+}
+static void loadStream( const std::string& prefix, const std::map<unsigned int, uint64_t>& sizes,
+    std::vector<TimerResults>& data )
+{
+    // Find the traces (the stream identifies a trace by the thread, rank and stack2)
+    std::map<std::tuple<unsigned int, unsigned int, uint64_t>, TraceResults*> traces;
+    for ( auto& timer : data ) {
+        for ( auto& trace : timer.trace )
+            traces[std::make_tuple( trace.thread, trace.rank, trace.stack2 )] = &trace;
+    }
+    // Read the chunks from the stream for each rank that wrote the trace file
+    //    (data may already contain the ranks loaded from other files)
+    struct Stream {
+        uint64_t shift = 0;
+        size_t N       = 0;
+        std::vector<uint8_t> data;
+    };
+    std::map<TraceResults*, Stream> streams;
+    for ( auto [r, size] : sizes ) {
+        auto filename = prefix + "." + std::to_string( r + 1 ) + ".stream";
+        FILE* fid     = fopen( filename.c_str(), "rb" );
+        if ( fid == nullptr )
+            continue; // The rank did not stream any data
+        // Only read the chunks that were written before the results were saved
+        uint64_t pos = 0;
+        while ( pos < size ) {
+            auto line = readLine( fid );
+            if ( line.empty() )
+                break;
+            auto field = getField( line, "thread=" );
+            ASSERT( !field.empty() );
+            auto thread = convert<unsigned int>( field );
+            field       = getField( line, "rank=" );
+            ASSERT( !field.empty() );
+            auto rank = convert<unsigned int>( field );
+            field     = getField( line, "stack2=" );
+            ASSERT( !field.empty() );
+            auto stack2 = str_to_hash( field );
+            field       = getField( line, "shift=" );
+            ASSERT( !field.empty() );
+            auto shift = convert<uint64_t>( field );
+            field      = getField( line, "N=" );
+            ASSERT( !field.empty() );
+            auto N = convert<uint64_t>( field );
+            field  = getField( line, "bytes=" );
+            ASSERT( !field.empty() );
+            auto bytes = convert<uint64_t>( field );
+            pos += line.size() + bytes + 2;
+            auto it = traces.find( std::make_tuple( thread, rank, stack2 ) );
+            if ( it == traces.end() ) {
+                // The trace was created after the results were copied
+                fseek( fid, bytes + 1, SEEK_CUR );
+                continue;
+            }
+            auto& chunks = streams[it->second];
+            if ( chunks.N == 0 )
+                chunks.shift = shift;
+            size_t offset = chunks.data.size();
+            chunks.data.resize( offset + bytes );
+            size_t N2 = fread( &chunks.data[offset], 1, bytes, fid );
+            ASSERT( N2 == bytes );
+            char memory[10];
+            size_t rtn2 = fread( memory, 1, 1, fid );
+            ASSERT( rtn2 == 1 );
+            chunks.N += N;
+        }
+        fclose( fid );
+    }
+    // Merge the streamed calls with the calls that were still in memory
+    // Note: calls may be streamed after the results were copied (see save), these are
+    //    in memory or after the results were copied so we stop at the first call in memory
+    for ( auto& [trace, chunks] : streams ) {
+        std::vector<uint64_t> start( trace->N_trace ), stop( trace->N_trace );
+        trace->getTimes( start.data(), stop.data() );
+        auto times = allocate<uint8_t>( chunks.data.size() + 20 * ( trace->N_trace + 1 ) );
+        size_t i = 0, pos = 0, N = 0;
+        uint64_t t2 = 0;
+        for ( size_t j = 0; j < chunks.N; j++ ) {
+            uint64_t s1 = t2 + decodeLEB128( chunks.data.data(), i );
+            uint64_t s2 = s1 + decodeLEB128( chunks.data.data(), i );
+            s1 += j == 0 ? chunks.shift : 0;
+            s2 += j == 0 ? chunks.shift : 0;
+            if ( !start.empty() && ( s1 > start[0] || ( s1 == start[0] && s2 >= stop[0] ) ) )
+                break;
+            pos += encodeLEB128( s1 - t2, &times[pos] );
+            pos += encodeLEB128( s2 - s1, &times[pos] );
+            t2 = s2;
+            N++;
         }
+        for ( size_t j = 0; j < trace->N_trace; j++ ) {
+            uint64_t dt1 = start[j] - std::min( start[j], t2 );
+            pos += encodeLEB128( dt1, &times[pos] );
+            pos += encodeLEB128( stop[j] - start[j], &times[pos] );
+            t2 = stop[j];
+            N++;
+        }
+        freeTimes( *trace );
+        trace->times   = times;
+        trace->N_trace = N;
     }
-    delete[] buffer;
 }
-static void loadTrace( const std::string& filename, std::vector<TimerResults>& data )
+static void loadTrace( const std::string& filename, std::vector<TimerResults>& data, bool lazy )
 {
     // Create a map of the ids and indicies of the timers (used for searching)
     std::map<id_struct, size_t> id_map;
@@ -2007,6 +4066,12 @@ static void loadTrace( const std::string& filename, std::vector<TimerResults>& d
     FILE* fid = fopen( filename.c_str(), "rb" );
     if ( fid == nullptr )
         throw std::logic_error( "Error opening file: " + filename );
+    // Map the file to memory (the detailed trace data is decoded from the file when used)
+    std::shared_ptr<MappedFile> map;
+    if ( lazy )
+        map = std::make_shared<MappedFile>( filename );
+    std::string stream;
+    std::map<unsigned int, uint64_t> stream_bytes;
     while ( true ) {
         // Read the header
         auto line = readLine( fid );
@@ -2014,6 +4079,24 @@ static void loadTrace( const std::string& filename, std::vector<TimerResults>& d
             break;
         if ( line[0] == '\1' )
             continue;
+        if ( isField( line, "stream=" ) ) {
+            stream = getField( line, "stream=" );
+            stream_bytes.clear();
+            auto bytes = getField( line, "bytes=" );
+            if ( bytes.size() >= 2 ) {
+                // Load the size of the stream for each rank ([rank:bytes;...])
+                bytes = bytes.substr( 1, bytes.size() - 2 );
+                while ( !bytes.empty() ) {
+                    size_t i = bytes.find( ':' );
+                    size_t j = std::min( bytes.find( ';' ), bytes.size() );
+                    ASSERT( i < j );
+                    auto r          = convert<unsigned int>( bytes.substr( 0, i ) );
+                    stream_bytes[r] = convert<uint64_t>( bytes.substr( i + 1, j - i - 1 ) );
+                    bytes           = bytes.substr( std::min( j + 1, bytes.size() ) );
+                }
+            }
+            continue;
+        }
         // Get the id and find the appropriate timer
         auto field = getField( line, "id=" );
         ASSERT( !field.empty() );
@@ -2048,6 +4131,8 @@ static void loadTrace( const std::string& filename, std::vector<TimerResults>& d
                 format = 0;
             else if ( field == "uint16f" )
                 format = 1;
+            else if ( field == "leb128" )
+                format = 2;
             else
                 throw std::logic_error( "Unknown format" );
         }
@@ -2061,8 +4146,7 @@ static void loadTrace( const std::string& filename, std::vector<TimerResults>& d
         ASSERT( index != -1 );
         TraceResults& trace = timer.trace[index];
         trace.N_trace       = 0;
-        delete[] trace.times;
-        trace.times = nullptr;
+        freeTimes( trace );
         // Read the data
         if ( format == 0 ) {
             std::vector<double> start( N ), stop( N );
@@ -2073,7 +4157,6 @@ static void loadTrace( const std::string& filename, std::vector<TimerResults>& d
             size_t rtn2 = fread( memory, 1, 1, fid );
             ASSERT( rtn2 == 1 );
             ProfilerApp::StoreTimes times;
-            times.reserve( N );
             for ( size_t i = 0; i < N; i++ ) {
                 uint64_t t1 = 1e9 * start[i];
                 uint64_t t2 = 1e9 * stop[i];
@@ -2082,16 +4165,49 @@ static void loadTrace( const std::string& filename, std::vector<TimerResults>& d
             trace.N_trace = times.size();
             trace.times   = times.take();
         } else if ( format == 1 ) {
-            trace.N_trace = N;
-            trace.times   = allocate<uint16f>( 2 * N );
-            size_t N2     = fread( trace.times, sizeof( uint16f ), 2 * N, fid );
+            // Older files store the times as uint16f, convert them
+            std::vector<uint16f> data( 2 * N );
+            size_t N2 = fread( data.data(), sizeof( uint16f ), 2 * N, fid );
             ASSERT( N2 == 2 * N );
             char memory[10];
             size_t rtn2 = fread( memory, 1, 1, fid );
             ASSERT( rtn2 == 1 );
+            ProfilerApp::StoreTimes times;
+            uint64_t last = 0;
+            for ( size_t i = 0; i < N; i++ ) {
+                uint64_t t1 = last + data[2 * i + 0];
+                uint64_t t2 = t1 + data[2 * i + 1];
+                times.add( t1, t2 );
+                last = t2;
+            }
+            trace.N_trace = times.size();
+            trace.times   = times.take();
+        } else if ( format == 2 ) {
+            field = getField( line, "bytes=" );
+            ASSERT( !field.empty() );
+            size_t length = convert<uint64_t>( field );
+            trace.N_trace = N;
+            if ( map ) {
+                // Use the data in the mapped file and skip it
+                int64_t offset = ftell64( fid );
+                ASSERT( offset >= 0 && offset + length < map->size() );
+                trace.times = reinterpret_cast<uint8_t*>( const_cast<char*>( map->data() ) );
+                trace.times += offset;
+                trace.file = map;
+                fseek64( fid, length + 1, SEEK_CUR );
+            } else {
+                trace.times = allocate<uint8_t>( length );
+                size_t N2   = fread( trace.times, 1, length, fid );
+                ASSERT( N2 == length );
+                char memory[10];
+                size_t rtn2 = fread( memory, 1, 1, fid );
+                ASSERT( rtn2 == 1 );
+            }
         }
     }
     fclose( fid );
+    if ( !stream.empty() )
+        loadStream( stream, stream_bytes, data );
 }
 static inline size_t getScale( std::string_view units )
 {
@@ -2166,7 +4282,7 @@ static void loadMemory( const std::string& filename, std::vector<MemoryResults>&
     }
     fclose( fid );
 }
-static int loadFiles( const std::string& filename, int index, TimerMemoryResults& data )
+static int loadFiles( const std::string& filename, int index, TimerMemoryResults& data, bool lazy )
 {
     int N_procs = 0;
     std::string date;
@@ -2177,38 +4293,105 @@ static int loadFiles( const std::string& filename, int index, TimerMemoryResults
     sprintf( memory, "%s.%i.memory", filename.c_str(), index );
     loadTimer( timer, data.timers, N_procs, data.walltime, date, trace_data, memory_data );
     if ( trace_data )
-        loadTrace( trace, data.timers );
+        loadTrace( trace, data.timers, lazy );
     if ( memory_data )
         loadMemory( memory, data.memory );
     return N_procs;
 }
-TimerMemoryResults ProfilerApp::load( const std::string& filename, int rank, bool global )
+// Merge the results loaded from another file (the same order as loading into data)
+static void mergeFiles( TimerMemoryResults& data, TimerMemoryResults&& data2,
+    std::map<id_struct, size_t>& id_map )
+{
+    for ( auto& timer : data2.timers ) {
+        auto it = id_map.find( timer.id );
+        if ( it == id_map.end() ) {
+            id_map.insert( std::pair<id_struct, size_t>( timer.id, data.timers.size() ) );
+            data.timers.push_back( std::move( timer ) );
+        } else {
+            auto& trace = data.timers[it->second].trace;
+            for ( auto& trace2 : timer.trace )
+                trace.push_back( std::move( trace2 ) );
+        }
+    }
+    for ( auto& memory : data2.memory )
+        data.memory.push_back( std::move( memory ) );
+    data.walltime = data2.walltime;
+    data2         = TimerMemoryResults();
+}
+TimerMemoryResults ProfilerApp::load(
+    const std::string& filename, int rank, bool global, bool lazy )
 {
     TimerMemoryResults data;
     data.timers.clear();
     data.memory.clear();
     int N_procs = 0;
     if ( global ) {
-        N_procs = loadFiles( filename, 0, data );
-        if ( rank != -1 ) {
-            for ( auto& timer : data.timers )
-                keepRank( timer.trace, rank );
-            keepRank( data.memory, rank );
-        }
+        N_procs = loadFiles( filename, 0, data, lazy );
     } else {
         if ( rank == -1 ) {
             // Load the root file
-            N_procs = loadFiles( filename, 1, data );
+            N_procs = loadFiles( filename, 1, data, lazy );
+            if ( N_procs <= 0 )
+                throw std::logic_error( "N_procs not found in " + filename + ".1.timer" );
             // Reserve trace memory for all ranks
             for ( auto& timer : data.timers )
                 timer.trace.reserve( N_procs * timer.trace.size() );
-            // Load the remaining files
-            for ( int i = 1; i < N_procs; i++ )
-                loadFiles( filename, i + 1, data );
+            int N_threads = d_load_threads;
+            if ( N_threads <= 0 )
+                N_threads = std::max<int>( std::thread::hardware_concurrency(), 1 );
+            N_threads = std::min( N_threads, N_procs - 1 );
+            if ( N_threads <= 1 ) {
+                // Load the remaining files
+                for ( int i = 1; i < N_procs; i++ )
+                    loadFiles( filename, i + 1, data, lazy );
+            } else {
+                // Load the remaining files in parallel
+                std::vector<TimerMemoryResults> data2( N_procs );
+                std::vector<std::exception_ptr> error( N_procs );
+                std::atomic_int next( 1 );
+                auto loadRanks = [&]() {
+                    for ( int i = next++; i < N_procs; i = next++ ) {
+                        try {
+                            loadFiles( filename, i + 1, data2[i], lazy );
+                        } catch ( ... ) {
+                            error[i] = std::current_exception();
+                        }
+                    }
+                };
+                std::vector<std::thread> threads;
+                for ( int i = 1; i < N_threads; i++ )
+                    threads.emplace_back( loadRanks );
+                loadRanks();
+                for ( auto& thread : threads )
+                    thread.join();
+                // Merge the files in rank order (the same results as loading sequentially)
+                std::map<id_struct, size_t> id_map;
+                for ( size_t i = 0; i < data.timers.size(); i++ )
+                    id_map.insert( std::pair<id_struct, size_t>( data.timers[i].id, i ) );
+                for ( int i = 1; i < N_procs; i++ ) {
+                    if ( error[i] )
+                        std::rethrow_exception( error[i] );
+                    mergeFiles( data, std::move( data2[i] ), id_map );
+                }
+            }
         } else {
-            N_procs = loadFiles( filename, rank + 1, data );
+            N_procs = loadFiles( filename, rank + 1, data, lazy );
+        }
+    }
+    // Fill walltime with largest timer (if it does not exist for backward compatibility)
+    if ( data.walltime < 0 ) {
+        data.walltime = 0;
+        for ( const auto& timer : data.timers ) {
+            for ( const auto& trace : timer.trace )
+                data.walltime = std::max( data.walltime, 1e-9 * trace.tot );
         }
     }
+    if ( global && rank != -1 ) {
+        // Keep the rank of interest
+        for ( auto& timer : data.timers )
+            keepRank( timer.trace, rank );
+        keepRank( data.memory, rank );
+    }
     data.N_procs = N_procs;
     // Clear any timers that are empty (missing on the current rank)
     size_t N = 0;
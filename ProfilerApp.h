@@ -7,6 +7,7 @@
 #include <chrono>
 #include <cstring>
 #include <iostream>
+#include <memory>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -18,6 +19,12 @@
 #include "uint16f.h"
 
 
+// Check if we are able to read the time stamp counter (x86-64 with gcc/clang)
+#if defined( __x86_64__ ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+#define TIMER_ENABLE_TSC
+#endif
+
+
 /** \class id_struct
  *
  * Structure to store id string
@@ -62,15 +69,47 @@ public:
     id_struct id;     //!<  ID of parent timer
     uint16_t thread;  //!<  Active thread
     uint32_t rank;    //!<  Rank
-    uint32_t N_trace; //!<  Number of calls that we trace
+    uint64_t N_trace; //!<  Number of calls that we trace
     float min;        //!<  Minimum call time (ns)
     float max;        //!<  Maximum call time (ns)
     float tot;        //!<  Total call time (ns)
+    float self;       //!<  Total exclusive call time (ns), excludes child timers (<0 if unknown)
+    float cpu;        //!<  Total thread CPU time (ns), excludes waiting (<0 if unknown)
+    float stdev;      //!<  Standard deviation of the call times (ns), <0 if unknown
+    float overhead;   //!<  Measured cost of a start/stop pair (ns)
     uint64_t N;       //!<  Total number of calls
+    uint64_t N_timed; //!<  Number of calls that were timed (<N if the timer was throttled)
+    uint64_t N_child; //!<  Number of calls to child timers
+    uint64_t N_desc;  //!<  Number of calls to all nested timers (children, grandchildren, ...)
+    uint8_t perf_set; //!<  Performance counters stored (see ProfilerApp::CounterSet)
+    uint64_t perf[4]; //!<  Total performance counts for the calls
     uint64_t stack;   //!<  Hash value of the stack trace
     uint64_t stack2;  //!<  Hash value of the stack trace (including this call)
-    uint16f* times;   //!<  Start/stop times for each call (N_trace)
+    uint8_t* times;   //!<  Start/stop times for each call (N_trace, see getTimes)
+    uint64_t* hist;   //!<  Histogram of the call times (HIST_SIZE, null if not stored)
+    uint64_t* slow;   //!<  Slowest calls (SLOW_SIZE start/duration pairs, null if not stored)
+    //! Mapped file that holds times (null if times is allocated, see ProfilerApp::load)
+    std::shared_ptr<const void> file;
 public:
+    //! Number of sub-bins for each power of 2 in the histogram
+    static constexpr int HIST_SUB = 8;
+    //! Number of bins in the histogram (times >= 2^48 ns are stored in the last bin)
+    static constexpr int HIST_SIZE = HIST_SUB * 46;
+    //! Get the histogram bin for a call time (ns)
+    static inline int histBin( uint64_t ns )
+    {
+        if ( ns < HIST_SUB )
+            return static_cast<int>( ns );
+        int e = 63 - clz64( ns );
+        if ( e >= 48 )
+            return HIST_SIZE - 1;
+        return ( e - 2 ) * HIST_SUB + static_cast<int>( ( ns >> ( e - 3 ) ) & ( HIST_SUB - 1 ) );
+    }
+    //! Get the call time (ns) at the center of a histogram bin
+    static double histValue( int bin );
+    //! Number of the slowest calls stored (slowest first, unused entries have a duration of 0)
+    static constexpr int SLOW_SIZE = 8;
+
     // Constructors/destructor
     TraceResults();
     ~TraceResults();
@@ -84,6 +123,69 @@ public:
     size_t unpack( const char* data );                        //!<  Unpack the data from a buffer
     bool operator==( const TraceResults& rhs ) const;         //! Comparison operator
     inline bool operator!=( const TraceResults& rhs ) const { return !( this->operator==( rhs ) ); }
+    //! Total call time with the overhead of the nested timers removed (ns)
+    inline float totCorrected() const { return correct( tot, N_desc ); }
+    //! Exclusive call time with the overhead of the child timers removed (ns)
+    inline float selfCorrected() const { return correct( self, N_child ); }
+    //! Get the given percentile (0-100) of the call times (ns), <0 if the histogram is not stored
+    float percentile( double p ) const;
+    /*!
+     * \brief  Get the start/stop times for each call
+     * \details  This decodes the detailed trace data.  For each call times stores the time
+     *    from the previous stop (or 0) to the start and the time from the start to the stop
+     *    as unsigned LEB128 integers.
+     * @param[out] start    Start time of each call (N_trace, ns)
+     * @param[out] stop     Stop time of each call (N_trace, ns)
+     */
+    void getTimes( uint64_t* start, uint64_t* stop ) const;
+    //! Get the start of the first call and the stop of the last call (ns), 0 if not traced
+    std::array<uint64_t, 2> getTimeRange() const;
+    //! Checkpoint in the detailed trace data (see indexTimes)
+    struct TimesIndex {
+        uint64_t call; //!<  Index of the next call
+        uint64_t pos;  //!<  Position of the next call in times (bytes)
+        uint64_t last; //!<  Stop time of the previous call (ns, 0 before the first call)
+    };
+    /*!
+     * \brief  Create a sparse index of the detailed trace data
+     * \details  This decodes the times once and stores a checkpoint every stride calls
+     *    (and after the last call) so that a time range can be decoded without decoding
+     *    the earlier calls (see getTimes).
+     * @param[in] stride    Number of calls between the checkpoints
+     */
+    std::vector<TimesIndex> indexTimes( size_t stride = 1024 ) const;
+    /*!
+     * \brief  Get the start/stop times for the calls in a time range
+     * \details  This decodes the calls that overlap [t0,t1], starting from the last
+     *    checkpoint before t0.
+     * @param[in] index     Index of the trace data (see indexTimes)
+     * @param[in] t0        Start of the time range (ns)
+     * @param[in] t1        End of the time range (ns)
+     * @param[out] start    Start time of each call in the range (ns)
+     * @param[out] stop     Stop time of each call in the range (ns)
+     */
+    void getTimes( const std::vector<TimesIndex>& index, uint64_t t0, uint64_t t1,
+        std::vector<uint64_t>& start, std::vector<uint64_t>& stop ) const;
+
+private:
+    static inline int clz64( uint64_t x )
+    {
+#if defined( __GNUC__ ) || defined( __clang__ )
+        return __builtin_clzll( x );
+#else
+        int n = 0;
+        while ( ( x & 0x8000000000000000 ) == 0 ) {
+            x <<= 1;
+            n++;
+        }
+        return n;
+#endif
+    }
+    inline float correct( float t, uint64_t N_calls ) const
+    {
+        float t2 = t - overhead * N_calls;
+        return t2 > 0 ? t2 : 0;
+    }
 };
 
 
@@ -113,6 +215,10 @@ public:
     size_t unpack( const char* data );                        //!<  Unpack the data from a buffer
     bool operator==( const TimerResults& rhs ) const;         //!<  Comparison operator
     inline bool operator!=( const TimerResults& rhs ) const { return !( this->operator==( rhs ) ); }
+    //! Get the given percentile (0-100) of the call times (ns) across all traces (threads/ranks)
+    float percentile( double p ) const;
+    //! Get the standard deviation of the call times (ns) across all traces (threads/ranks)
+    float stdev() const;
 };
 
 
@@ -256,7 +362,7 @@ public:
     static inline void stop( uint64_t id, int level = 0, int trace = -1 )
     {
         if ( level <= d_level && level >= 0 ) {
-            auto end_time = std::chrono::steady_clock::now();
+            auto end_time = getTime();
             auto timer    = getBlock( id );
             stop( timer, end_time, trace );
         }
@@ -280,6 +386,36 @@ public:
      */
     static void save( const std::string& filename, bool global = true );
 
+    /*!
+     * \brief  Function to periodically save the profiling info
+     * \details  This starts a background thread that saves the current timer info
+     *    (see save) every interval seconds to filename.<seq>.x.timer, where seq counts
+     *    the snapshots.  Only the last keep snapshots are kept so a long running
+     *    process loses at most one interval of data if it dies.  Each process saves
+     *    its own files (global=false) without calling MPI from the background thread.
+     *    The timed threads only wait for a snapshot if they create a new timer or
+     *    start profiling a new thread (see getTimerResults).
+     *    Calling with an empty filename or interval <= 0 stops the thread.
+     * @param[in] filename  File name for saving the results
+     * @param[in] interval  Time between snapshots (seconds)
+     * @param[in] keep      Number of snapshots to keep
+     */
+    static void setAutoSave( const std::string& filename, double interval, int keep = 2 );
+
+    /*!
+     * \brief  Function to change the format of the detailed timer data
+     * \details  By default save writes the timer and trace records to the .x.timer file as
+     *    text that load must parse.  If binary is set the records are written to .x.tbin
+     *    (a header, a timer index, fixed-width trace records and a string table) that load
+     *    memory-maps with little parsing.  The human-readable summary table is still written
+     *    to the .x.timer file.
+     * @param[in] binary    Do we want to save the binary format
+     */
+    static void setSaveBinary( bool binary );
+
+    //! Return if we are saving the binary format
+    static inline bool getSaveBinary() { return d_save_binary; }
+
     /*!
      * \brief  Function to load the profiling info
      * \details  This will load the timing and trace info from a file
@@ -287,9 +423,24 @@ public:
      *                      Note: .x.timer will be automatically appended to the filename
      * @param[in] rank      Rank to load (-1: all ranks)
      * @param[in] global    Save the time results in a global file (default is false)
+     * @param[in] lazy      Map the .trace files to memory instead of reading the detailed
+     *                      trace data.  The times are read from the file when they are
+     *                      decoded (see TraceResults::getTimes) so only the traces that are
+     *                      used are loaded.  The files are unmapped when the last trace
+     *                      that uses them is destroyed.
      */
     static TimerMemoryResults load(
-        const std::string& filename, int rank = -1, bool global = true );
+        const std::string& filename, int rank = -1, bool global = true, bool lazy = false );
+
+    /*!
+     * \brief  Function to set the number of threads used by load
+     * \details  When all ranks are loaded from individual files (see load) the files are
+     *    parsed concurrently and merged in rank order, so the results do not depend on
+     *    the number of threads.
+     * @param[in] N_threads Number of threads (0: one per hardware thread, 1: load each file
+     *                      directly into the results)
+     */
+    static void setLoadThreads( int N_threads );
 
     /*!
      * \brief  Function to synchronize the timers
@@ -323,6 +474,114 @@ public:
      */
     static void setStoreTrace( bool profile );
 
+    /*!
+     * \brief  Function to keep only the most recent trace data
+     * \details  By default the detailed trace data (see setStoreTrace) keeps the first
+     *    calls to each trace and stops recording when the buffer is full.  This function
+     *    switches each trace to a ring buffer (flight recorder) that keeps the N most recent
+     *    calls and, if seconds > 0, only the calls that ended in the last seconds.  This
+     *    allows tracing to be left on and the last calls to be saved on demand.
+     * @param[in] N         Maximum number of calls to keep for each trace (0: no limit)
+     * @param[in] seconds   Time window to keep for each trace (0: no limit)
+     */
+    static void setTraceWindow( size_t N, double seconds = 0 );
+
+    //! Return the maximum number of calls kept for each trace (0 if not set)
+    static inline size_t getTraceWindow() { return d_trace_size; }
+
+    /*!
+     * \brief  Function to filter the calls stored in the detailed trace data
+     * \details  Timers that are called many times with short durations fill the detailed
+     *    trace data (see setStoreTrace) with calls that are rarely of interest.  This function
+     *    only stores the calls that took at least min_time seconds and at most max_rate calls
+     *    per second for each trace (a call is not stored if it starts within 1/max_rate
+     *    seconds of the end of the last stored call).  All calls are still included in the
+     *    timer statistics.
+     * @param[in] min_time  Minimum duration of a stored call (seconds, 0: store all calls)
+     * @param[in] max_rate  Maximum number of calls stored per second for each trace (0: no limit)
+     */
+    static void setTraceFilter( double min_time, double max_rate = 0 );
+
+    /*!
+     * \brief  Function to stream the detailed trace data to disk
+     * \details  By default the detailed trace data (see setStoreTrace) is kept in memory
+     *    until save and the number of calls stored for each trace is limited.  This function
+     *    starts a background thread that appends the full blocks of each trace to
+     *    filename.x.stream so the length of a trace is only limited by the disk.  save then
+     *    only writes the calls that are still in memory and a reference to the stream (with
+     *    its current size), and load merges the two ignoring the calls streamed after the
+     *    save.  While streaming the ring buffer (see setTraceWindow) is not
+     *    used and getTimerResults only returns the calls that are still in memory.
+     *    The profiler must be enabled.  The stream is closed when the profiler is disabled
+     *    or if the filename is empty.
+     * @param[in] filename  File name for the stream (.x.stream is appended, x is rank+1)
+     */
+    static void setTraceStream( const std::string& filename );
+
+    /*!
+     * \brief  Function to change if we are storing the thread CPU time
+     * \details  This function will change if we sample the CPU time of the calling thread
+     *    (CLOCK_THREAD_CPUTIME_ID) at each start/stop.  The difference between the total
+     *    time and the CPU time is the time the thread was waiting (blocked or descheduled).
+     *    Note: this adds the cost of reading the thread clock to each start/stop.  If the
+     *    thread clock is not available this function does nothing.
+     * @param[in] cpu       Do we want to store the thread CPU time
+     */
+    static void setStoreCPU( bool cpu );
+
+    //! Return if we are storing the thread CPU time
+    static inline bool getStoreCPU() { return d_store_cpu; }
+
+    /*!
+     * \brief  Function to change if we are storing a histogram of the call times
+     * \details  This function will change if we store a log-linear histogram of the call
+     *    times for each trace (TraceResults::HIST_SIZE bins with HIST_SUB bins for each
+     *    power of 2).  The histogram allows the percentiles of the call times to be
+     *    computed from the results (see TraceResults::percentile and
+     *    TimerResults::percentile).
+     * @param[in] hist      Do we want to store the histogram
+     */
+    static void setStoreHistogram( bool hist );
+
+    //! Return if we are storing the histogram of the call times
+    static inline bool getStoreHistogram() { return d_store_hist; }
+
+    /*!
+     * \brief  Function to change if we are storing the slowest calls
+     * \details  This function will change if each trace keeps the start time and duration
+     *    of its TraceResults::SLOW_SIZE slowest calls.  This does not require the detailed
+     *    trace data (see setStoreTrace) and only adds a comparison to most calls, so the
+     *    outliers responsible for the tail latency can be found in production runs.
+     * @param[in] slow      Do we want to store the slowest calls
+     */
+    static void setStoreSlowest( bool slow );
+
+    //! Return if we are storing the slowest calls
+    static inline bool getStoreSlowest() { return d_store_slow; }
+
+    /*!
+     * \brief  Enum defining the performance counters
+     * \details  Hardware counts the instructions, cycles, cache misses and branch misses.
+     *    Software (used if the hardware counters are not available) counts the task clock
+     *    (ns), page faults, context switches and cpu migrations.
+     */
+    enum class CounterSet : uint8_t { None = 0, Hardware = 1, Software = 2 };
+
+    /*!
+     * \brief  Function to change if we are storing performance counters
+     * \details  This function will change if we read the performance counters of the calling
+     *    thread (perf_event_open) at each start/stop.  The hardware counters are used if
+     *    they are available, otherwise we fall back to the software counters.
+     *    The counts are scaled by the time enabled/running if the counters are multiplexed.
+     *    Note: reading the counters is a system call and adds ~1 us to each start/stop.
+     *    This is only supported on Linux, other systems will not store the counters.
+     * @param[in] counters  Do we want to store the performance counters
+     */
+    static void setStoreCounters( bool counters );
+
+    //! Return the performance counters we are storing
+    static inline CounterSet getStoreCounters() { return d_counters; }
+
     //! Enum defining the level of memory detail
     enum class MemoryLevel : int8_t { None = 0, Pause = 1, Fast = 2, Full = 3 };
 
@@ -344,6 +603,48 @@ public:
     //! Get the current memory level
     static MemoryLevel getStoreMemory();
 
+    //! Enum defining the clock used for timing
+    enum class ClockSource : int8_t { Steady = 0, TSC = 1 };
+
+    /*!
+     * \brief  Function to change the clock used for timing
+     * \details  This function will change the clock used to time the blocks of code.
+     *    The default is std::chrono::steady_clock.  The TSC option will read the invariant
+     *    time stamp counter directly, which is significantly faster.  The counter is
+     *    calibrated against steady_clock when the profiler is enabled (the scale is not
+     *    changed while the profiler is running so the times stay monotonic), so all stored
+     *    times remain in ns.  If the processor does not have an invariant TSC or the TSC is
+     *    slower than 1 GHz we will fall back to steady_clock (see getClockSource).
+     * @param[in] clock     The clock to use
+     */
+    static void setClockSource( ClockSource clock );
+
+    //! Get the clock used for timing
+    static inline ClockSource getClockSource() { return d_clock; }
+
+    /*!
+     * \brief  Get the profiler overhead
+     * \details  This function returns the measured cost of a start/stop pair (ns) as seen
+     *    by an enclosing timer.  It is measured when the profiler is enabled and when the
+     *    clock, trace, or memory settings change.  It is used to estimate the overhead
+     *    included in the timers (see TraceResults::totCorrected/selfCorrected).
+     */
+    static inline float getOverhead() { return d_overhead; }
+
+    /*!
+     * \brief  Set the overhead budget
+     * \details  This function sets the maximum fraction of the runtime that a single trace
+     *    may spend in the profiler.  If the calls to a trace exceed the budget (the call
+     *    rate times the overhead), the trace is throttled and only every Nth call is timed.
+     *    The total and exclusive times of a throttled trace are scaled by the number of
+     *    calls (see TraceResults::N_timed).  The default (0) times every call.
+     * @param[in] fraction  Fraction of the runtime allowed for the profiler (e.g. 0.01)
+     */
+    static void setOverheadBudget( double fraction );
+
+    //! Get the overhead budget
+    static inline double getOverheadBudget() { return d_budget; }
+
     //! Return the current timer level
     static inline int getLevel() { return d_level; }
 
@@ -382,10 +683,24 @@ public:
      */
     static inline uint64_t getTimerId2( const char* message, const char* filename, int line );
 
+    /*!
+     * \brief  Function to register a static timer
+     * \details  This function registers a timer call site and returns a dense index that
+     *     can be used to find the thread-specific timer data directly without searching
+     *     the hash table.  It is called once per call site (PROFILE) during static
+     *     initialization.  An index of 0 is reserved to indicate an unregistered timer.
+     * @param[in] id        The timer id (see getTimerId)
+     */
+    static uint32_t registerTimer( uint64_t id );
+
     /*!
      * \brief  Function to return the current timer results
      * \details  This function will return a vector containing the
      *      current timing results for all threads.
+     *      It may be called while other threads are running timers:
+     *      the statistics and trace data of each trace are a consistent
+     *      snapshot.  The other threads only wait for this call if they
+     *      create a new timer or start profiling a new thread.
      */
     static std::vector<TimerResults> getTimerResults();
 
@@ -412,46 +727,119 @@ public: // Helper functions
     constexpr static inline uint64_t hashString( const char* str );
 
 public: // Constants to determine parameters that affect performance/memory
-    // The size of the hash table to store the timers/ (must be a power of 2)
-    constexpr static uint64_t HASH_SIZE = 1024;
+    // The initial size of the hash tables used to store the timers (must be a power of 2)
+    constexpr static uint64_t HASH_SIZE = 16;
 
 
 public: // Member classes
     //! Convience typedef for storing a point in time
     typedef std::chrono::time_point<std::chrono::steady_clock> time_point;
 
-    // Structure to store a sorted list of times (future work: unsigned LEB128)
+    // Bump allocator used to store the profiler data for a thread
+    // Note: memory is allocated in large blocks with malloc (bypassing the new/delete
+    //    overloads) and is only released in bulk (reset).  Destructors are not called.
+    class Arena
+    {
+    public:
+        Arena();
+        ~Arena();
+        Arena( const Arena& rhs )            = delete;
+        Arena& operator=( const Arena& rhs ) = delete;
+        inline void* allocate( size_t bytes );
+        const char* copy( const char* str );
+        void reset();
+        inline size_t bytes() const { return d_bytes; }
+
+    private:
+        // The size of each block (64 KB)
+        constexpr static size_t BLOCK_SIZE = 0x10000;
+        // Header for each block
+        struct alignas( 16 ) Block {
+            Block* next; // Next block in the list
+        };
+        void* allocateBlock( size_t bytes );
+        // Internal data
+        char* d_ptr;    // Current position in the active block
+        char* d_end;    // End of the active block
+        Block* d_head;  // List of all blocks
+        size_t d_bytes; // Total bytes allocated
+    };
+
+    // Structure to store a sorted list of times (unsigned LEB128 deltas)
+    // Note: The data is stored in a list of fixed size blocks (allocated from the thread's
+    //    arena if given) so adding an entry never copies the existing data.  If ring or
+    //    window is set the data is a ring buffer that keeps the most recent entries (at
+    //    most ring entries that end within window ns of the last start).
     class StoreTimes
     {
+        struct Block;
+
     public:
-        StoreTimes();
+        // The entries stored at a point in time (see view)
+        struct View {
+            const Block* first; // Block containing the oldest entry
+            size_t head;        // Position of the oldest entry in first
+            size_t size;        // Number of entries
+            size_t length;      // Number of bytes
+            uint64_t base;      // Offset of the oldest entry
+        };
+        explicit StoreTimes( Arena* arena = nullptr );
         ~StoreTimes();
         StoreTimes( const StoreTimes& rhs )            = delete;
         StoreTimes& operator=( const StoreTimes& rhs ) = delete;
-        explicit StoreTimes( const StoreTimes& rhs, uint64_t shift );
-        inline void reserve( size_t N );
         inline size_t size() const { return d_size; }
-        inline void add( uint64_t start, uint64_t stop );
-        inline const uint16f* begin() const { return d_data; }
-        inline const uint16f* end() const { return &d_data[2 * d_size]; }
-        inline uint16f* take();
+        inline size_t length() const { return d_length; }
+        inline void add( uint64_t start, uint64_t stop, size_t ring = 0, uint64_t window = 0 );
+        // Check if the first block is full (the entries can be spilled)
+        inline bool full() const { return d_first != d_last; }
+        // The stop time of the last entry added (0 if no entries were added)
+        inline uint64_t last() const { return d_offset; }
+        // Remove the entries that start in the first block, calls write( data, bytes, N )
+        template<class FUN>
+        inline void spill( FUN write );
+        // Get the entries currently stored (they may be copied while entries are added)
+        inline View view() const { return { d_first, d_head, d_size, d_length, d_base }; }
+        static uint8_t* copy( const View& view, uint64_t shift, uint64_t first, size_t& N );
+        inline uint8_t* take();
+        void clear();
 
     private:
-        // The maximum number of entries to store (we need 4 bytes/entry)
+        // The maximum number of entries to store
         constexpr static size_t MAX_TRACE = 1000000;
+        // The maximum number of bytes for an entry
+        constexpr static size_t MAX_BYTES = 20;
+        // The number of bytes stored in each block
+        constexpr static size_t BLOCK_BYTES = 4096 - sizeof( void* );
+        struct Block {
+            Block* next;               // Next block in the list
+            uint8_t data[BLOCK_BYTES]; // Encoded data
+        };
+        // Decode the entry at the given position (advances the position)
+        static inline void read( const Block*& block, size_t& i, uint64_t& start, uint64_t& dt );
+        // Remove the oldest entry
+        inline void pop();
+        // Get an empty block
+        inline Block* newBlock();
         // Internal data
-        size_t d_capacity; // Capacity of d_data
+        Arena* d_arena;    // Arena used to allocate the blocks (malloc if null)
+        Block* d_first;    // Block containing the oldest entry
+        Block* d_last;     // Block containing the newest entry
+        Block* d_free;     // Oldest block removed from the ring buffer (linked to d_first)
+        size_t d_head;     // Position of the oldest entry in d_first
+        size_t d_tail;     // Position after the newest entry in d_last
         size_t d_size;     // Number of entries stored
+        size_t d_length;   // Number of bytes stored
+        uint64_t d_base;   // Offset of the oldest entry (time of the entries removed)
         uint64_t d_offset; // Current offset
-        uint16f* d_data;   // Data to store compressed data
     };
 
     // Structure to store memory usage
+    // Note: The data is stored in a list of fixed size blocks allocated from the thread's arena
     class StoreMemory
     {
     public:
-        StoreMemory();
-        ~StoreMemory();
+        explicit StoreMemory( Arena& arena );
+        ~StoreMemory() = default;
         inline StoreMemory( const StoreMemory& rhs )            = delete;
         inline StoreMemory& operator=( const StoreMemory& rhs ) = delete;
         inline void add(
@@ -463,11 +851,56 @@ public: // Member classes
     private:
         // The maximum number of memory traces allowed
         constexpr static size_t MAX_ENTRIES = 0x6000000;
+        // The number of entries stored in each block
+        constexpr static size_t BLOCK_ENTRIES = 255;
+        struct Block {
+            Block* next;                   // Next block in the list
+            uint64_t time[BLOCK_ENTRIES];  // The times at which we know the memory usage
+            uint64_t bytes[BLOCK_ENTRIES]; // The memory usage at each time
+        };
         // Internal data
-        size_t d_capacity;
-        size_t d_size;
-        uint64_t* d_time;  // The times at which we know the memory usage (ns from start)
-        uint64_t* d_bytes; // The memory usage at each time
+        Arena* d_arena;    // Arena used to allocate the blocks
+        Block* d_first;    // First block
+        Block* d_last;     // Block containing the newest entry
+        size_t d_size;     // Number of entries stored
+        size_t d_tail;     // Number of entries in d_last
+        uint64_t d_bytes2; // The memory usage of the second newest entry
+    };
+
+    // Open addressing hash table (linear probing) mapping a key to a pointer
+    // Note: only the owning thread may call insert/grow/clear, other threads
+    //    must hold the global lock to read the table (growth is done under the lock)
+    template<class TYPE>
+    class HashTable
+    {
+    public:
+        HashTable();
+        ~HashTable();
+        HashTable( const HashTable& rhs )            = delete;
+        HashTable& operator=( const HashTable& rhs ) = delete;
+        inline TYPE* find( uint64_t key ) const;
+        inline bool full() const { return 2 * ( d_size + 1 ) > d_capacity; }
+        inline size_t size() const { return d_size; }
+        inline size_t capacity() const { return d_capacity; }
+        inline size_t bytes() const { return d_capacity * sizeof( Entry ); }
+        inline TYPE* operator[]( size_t i ) const { return d_data[i].data; }
+        void insert( uint64_t key, TYPE* data );
+        void grow();
+        void clear();
+
+    private:
+        struct Entry {
+            uint64_t key; // The key (a null data pointer indicates an empty entry)
+            TYPE* data;   // Pointer to the data
+        };
+        static inline size_t hash( uint64_t key, int shift )
+        {
+            return ( key * 0x9E3779B97F4A7C15 ) >> shift;
+        }
+        uint32_t d_size;     // Number of entries stored
+        uint32_t d_capacity; // Capacity of d_data (0 or a power of 2)
+        int d_shift;         // Shift used to convert the hash to an index (64-log2(capacity))
+        Entry* d_data;       // Table entries
     };
 
     // Structure to store the info for a trace log
@@ -479,28 +912,63 @@ public: // Member classes
         uint64_t min_time;   // Store the minimum time spent in the given block (nano-seconds)
         uint64_t max_time;   // Store the maximum time spent in the given block (nano-seconds)
         uint64_t total_time; // Store the total time spent in the given block (nano-seconds)
+        uint64_t self_time;  // Store the exclusive time spent in the given block (nano-seconds)
+        uint64_t shift;      // Time of the first call (used to compute the variance)
+        double sum_sq;       // Sum of the squared difference from shift (used for the variance)
+        uint64_t child_time; // Time spent in child timers for the current call (nano-seconds)
+        uint64_t cpu_start;  // Thread CPU time when start was called (0 if not sampled)
+        uint64_t cpu_time;   // Store the thread CPU time spent in the given block (nano-seconds)
+        uint64_t perf0[6];   // Performance counters (and enabled/running times) at start
+        uint64_t perf[4];    // Store the performance counts for the given block
+        uint64_t* hist;      // Histogram of the call times (allocated from the thread arena)
+        uint64_t* slow;      // Min-heap of the slowest calls (start/duration, thread arena)
+        CounterSet perf_set; // Performance counters read at start (None if not sampled)
+        CounterSet perf_sum; // Performance counters in perf (None if not stored)
+        uint64_t N_child;    // Number of calls to child timers
+        uint64_t N_desc;     // Number of calls to all nested timers
+        uint64_t desc_calls; // Number of calls to nested timers for the current call
+        uint64_t N_timed;    // Number of calls that were timed (<N_calls if throttled)
+        uint64_t check_time; // Time of the last overhead budget check (nano-seconds)
+        uint32_t stride;     // Time every Nth call (1 if the trace is not throttled)
+        uint32_t skip;       // Number of calls since the last timed call
         StoreTimes times;    // Store when start/stop was called (nano-seconds from constructor)
+        store_trace* parent; // The active trace when this trace was started
         store_trace* next;   // Store the next trace
-        store_trace( uint64_t stack = 0 );
-        ~store_trace();
+        // Sequence number for readers (odd while the owning thread is updating the trace)
+        std::atomic_uint32_t seq;
+        explicit store_trace( uint64_t stack = 0, Arena* arena = nullptr );
+        ~store_trace() = default;
+        inline bool timed() const { return start != skipStart; }
+        inline void beginUpdate()
+        {
+            seq.store( seq.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+            std::atomic_thread_fence( std::memory_order_release );
+        }
+        inline void endUpdate()
+        {
+            seq.store( seq.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+        }
+        static constexpr uint64_t skipStart = static_cast<uint64_t>( (int64_t) -2 );
         store_trace( const store_trace& rhs )            = delete;
         store_trace& operator=( const store_trace& rhs ) = delete;
     };
 
     // Structure to store the timing information for a single block of code
     struct store_timer {
-        uint64_t id;             // A unique id for each timer
-        bool alloc_msg;          // Did we allocate the data for message
-        bool alloc_file;         // Did we allocate the data for filename
-        int line;                // The line number for the timer
-        const char* message;     // The message to identify the block of code
-        const char* filename;    // The file name (may include path)
-        store_trace* trace_head; // Pointer to the first trace
-        store_timer* next;       // Pointer to the next entry in the list
+        uint64_t id;                   // A unique id for each timer
+        int line;                      // The line number for the timer
+        const char* message;           // The message to identify the block of code
+        const char* filename;          // The file name (may include path)
+        store_trace* trace_head;       // Pointer to the first trace
+        store_trace* last;             // Pointer to the most recently used trace
+        uint32_t N_trace;              // Number of traces
+        HashTable<store_trace> traces; // Hash table of traces (only used for many traces)
         store_timer();
         store_timer( uint64_t id, const char* message, const char* filename, int line,
-            bool static_msg, bool static_file );
+            bool static_msg, bool static_file, Arena& arena );
         ~store_timer();
+        inline store_trace* findTrace( uint64_t stack );
+        store_trace* addTrace( uint64_t stack, uint64_t stack2, Arena& arena );
         store_timer( store_timer&& )                     = delete;
         store_timer( const store_timer& )                = delete;
         store_timer& operator=( const store_timer& rhs ) = delete;
@@ -514,32 +982,58 @@ public: // Member classes
         uint64_t stack;                 // Current stack hash
         uint64_t hash;                  // std::hash of std::thread::id
         ThreadData* next;               // Pointer to the next entry in the list
-        store_timer* timers[HASH_SIZE]; // Hash table containing timer data
+        store_trace* active;            // The currently active trace (top of the stack)
+        uint32_t N_index;               // Size of the static timer index
+        store_timer** index;            // Timers indexed by the static index (see registerTimer)
+        HashTable<store_timer> timers;  // Hash table containing timer data
+        Arena arena;                    // Storage for the timers/traces/memory data
         StoreMemory memory;             // Memory usage data
-        ThreadData();
+        CounterSet perf_set;            // Performance counters requested for the thread
+        int perf_fd[4];                 // perf_event_open file descriptors (-1 if not open)
+        int cpu_clock;                  // CPU-time clock of the thread (-1 if not available)
+        explicit ThreadData( bool assignId = true );
         ~ThreadData();
         ThreadData( ThreadData&& )                 = delete;
         ThreadData( const ThreadData& )            = delete;
         ThreadData& operator=( ThreadData&& )      = delete;
         ThreadData& operator=( const ThreadData& ) = delete;
-        void reset() volatile;
+        void reset();
     };
 
 public: // Advanced interfaces, not intended for users
+    static inline uint64_t getTime(); // Current time (ns since the profiler was enabled)
     static store_trace* start( store_timer* timer );
-    static void stop( store_timer* timer, time_point end_time, int enableTrace );
-    static void stop( store_trace* trace, time_point end_time, int enableTrace );
+    static void stop( store_timer* timer, uint64_t end_time, int enableTrace );
+    static void stop( store_trace* trace, uint64_t end_time, int enableTrace );
     static inline store_timer* getBlock( uint64_t id );
     static inline store_timer* getBlock( uint64_t id, const char* message, const char* filename,
         int line, bool static_msg, bool static_file );
+    static inline store_timer* getStaticBlock(
+        uint32_t index, uint64_t id, const char* message, const char* filename, int line );
 
 private:                                         // Member data
     static bool d_store_trace_data;              // Store trace information (default value)?
+    static size_t d_trace_size;                  // Number of calls kept for each trace (ring)
+    static uint64_t d_trace_window;              // Time window kept for each trace (ns)
+    static uint64_t d_trace_min;                 // Minimum duration of a stored call (ns)
+    static uint64_t d_trace_gap;                 // Minimum time between stored calls (ns)
+    static bool d_store_cpu;                     // Store the thread CPU time?
+    static bool d_store_hist;                    // Store the histogram of the call times?
+    static bool d_store_slow;                    // Store the slowest calls?
+    static bool d_save_binary;                   // Save the binary timer format?
+    static int d_load_threads;                   // Number of threads used by load (0: auto)
+    static CounterSet d_counters;                // Performance counters to store
     static MemoryLevel d_store_memory_data;      // Store memory information?
     static bool d_disable_timer_error;           // Disable the timer errors for start/stop?
     static int8_t d_level;                       // Timer level (default is 0, -1 is disabled)
     static uint64_t d_shift;                     // Offset to synchronize the trace data
     static volatile std::atomic_int64_t d_bytes; // The current memory used by the profiler
+    static ClockSource d_clock;                  // The clock used for timing
+    static time_point d_construct_time;          // The time the profiler was enabled
+    static uint64_t d_tsc_start;                 // The TSC value at d_construct_time
+    static uint64_t d_tsc_scale;                 // Conversion from TSC ticks to ns (32.32)
+    static float d_overhead;                     // Measured cost of a start/stop pair (ns)
+    static float d_budget;                       // Fraction of the runtime allowed per trace
 
 private: // Private member functions
     ProfilerApp() = delete;
@@ -552,9 +1046,50 @@ private: // Private member functions
     }
     static ThreadData* createThreadData();
 
-    // Function to get the timer results
+    // Function to create a new timer and add it to the thread's hash table
+    static store_timer* addBlock( ThreadData* thread, uint64_t id, const char* message,
+        const char* filename, int line, bool static_msg, bool static_file );
+
+    // Function to add a timer to the static index
+    static store_timer* addStaticBlock( ThreadData* thread, uint32_t index, uint64_t id,
+        const char* message, const char* filename, int line );
+
+    // Function to get the timer results (rank is passed so we do not call MPI)
+    static std::vector<TimerResults> getTimerResults( int rank );
     static inline void getTimerResultsID(
-        uint64_t id, int rank, const time_point& end_time, TimerResults& results );
+        uint64_t id, int rank, uint64_t end_time, TimerResults& results );
+
+    // Start/stop a timer for the given thread
+    static inline store_trace* start( ThreadData& thread, store_timer* timer );
+    static inline void stop(
+        ThreadData& thread, store_trace* trace, uint64_t end_time, int enableTrace );
+    static inline void stopTrace(
+        ThreadData& thread, store_trace* trace, uint64_t end_time, int enableTrace );
+
+    // Function to save the results (MPI is only used if global is true)
+    static void save( const std::string& filename, bool global, int rank, int N_procs );
+
+    // Measure the cost of a start/stop pair (using a private thread)
+    static void calibrateOverhead();
+
+    // Check if a trace exceeds the overhead budget and update the stride
+    static void throttle( store_trace* trace, uint64_t time );
+
+    // Calibrate the TSC against steady_clock (returns false if the TSC cannot be used)
+    static bool calibrateTSC();
+
+    // Get the time elapsed in ns
+    // Note we implement this because duration_cast takes too long in debug
+    static inline int64_t diff_ns( const time_point& t2, const time_point& t1 )
+    {
+        using PERIOD = typename time_point::period;
+        if constexpr ( std::ratio_equal_v<PERIOD, std::nano> && sizeof( time_point ) == 8 ) {
+            return *reinterpret_cast<const int64_t*>( &t2 ) -
+                   *reinterpret_cast<const int64_t*>( &t1 );
+        } else {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>( t2 - t1 ).count();
+        }
+    }
 };
 
 
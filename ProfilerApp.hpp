@@ -8,51 +8,67 @@
 #include <stdexcept>
 
 
+/***********************************************************************
+ * Hash table lookup                                                    *
+ ***********************************************************************/
+template<class TYPE>
+inline TYPE* ProfilerApp::HashTable<TYPE>::find( uint64_t key ) const
+{
+    if ( d_size == 0 )
+        return nullptr;
+    size_t mask = d_capacity - 1;
+    for ( size_t i = hash( key, d_shift );; i = ( i + 1 ) & mask ) {
+        auto& entry = d_data[i];
+        if ( entry.key == key || !entry.data )
+            return entry.data;
+    }
+}
+
+
+/***********************************************************************
+ * Function to get the current time (ns since the profiler was enabled) *
+ ***********************************************************************/
+inline uint64_t ProfilerApp::getTime()
+{
+#ifdef TIMER_ENABLE_TSC
+    if ( d_clock == ClockSource::TSC ) {
+        // Compute ( ticks * d_tsc_scale ) >> 32 without overflow (d_tsc_scale < 2^32)
+        uint64_t ticks = __builtin_ia32_rdtsc() - d_tsc_start;
+        return ( ticks >> 32 ) * d_tsc_scale + ( ( ( ticks & 0xFFFFFFFF ) * d_tsc_scale ) >> 32 );
+    }
+#endif
+    return diff_ns( std::chrono::steady_clock::now(), d_construct_time );
+}
+
+
 /***********************************************************************
  * Function to get the timer for a particular block of code             *
  * Note: This function performs some blocking as necessary.             *
  ***********************************************************************/
 inline ProfilerApp::store_timer* ProfilerApp::getBlock( uint64_t id )
 {
-    constexpr uint64_t mask = HASH_SIZE - 1;
-    uint64_t key            = id & mask; // Get the hash index
-    auto thread             = getThreadData();
-    store_timer* timer      = thread->timers[key];
-    if ( !timer )
-        return nullptr;
-    while ( timer->id != id ) {
-        if ( timer->next == nullptr )
-            return nullptr;
-        timer = timer->next;
-    }
-    return timer;
+    return getThreadData()->timers.find( id );
 }
 inline ProfilerApp::store_timer* ProfilerApp::getBlock( uint64_t id, const char* message,
     const char* filename, int line, bool static_msg, bool static_file )
 {
-    constexpr uint64_t mask = HASH_SIZE - 1;
-    uint64_t key            = id & mask; // Get the hash index
-    auto thread             = getThreadData();
-    store_timer* timer      = thread->timers[key];
-    if ( !timer ) {
-        auto new_timer = new store_timer( id, message, filename, line, static_msg, static_file );
-        d_bytes.fetch_add( sizeof( store_timer ) );
-        new_timer->id       = id;
-        thread->timers[key] = new_timer;
-        timer               = new_timer;
-    }
-    while ( timer->id != id ) {
-        if ( timer->next == nullptr ) {
-            auto new_timer =
-                new store_timer( id, message, filename, line, static_msg, static_file );
-            d_bytes.fetch_add( sizeof( store_timer ) );
-            new_timer->id = id;
-            timer->next   = new_timer;
-        }
-        timer = timer->next;
-    }
+    auto thread = getThreadData();
+    auto timer  = thread->timers.find( id );
+    if ( !timer )
+        timer = addBlock( thread, id, message, filename, line, static_msg, static_file );
     return timer;
 }
+inline ProfilerApp::store_timer* ProfilerApp::getStaticBlock(
+    uint32_t index, uint64_t id, const char* message, const char* filename, int line )
+{
+    auto thread = getThreadData();
+    if ( index < thread->N_index ) {
+        auto timer = thread->index[index];
+        if ( timer )
+            return timer;
+    }
+    return addStaticBlock( thread, index, id, message, filename, line );
+}
 
 
 /***********************************************************************
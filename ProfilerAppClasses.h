@@ -5,6 +5,25 @@
 #include "ProfilerApp.h"
 
 
+/** \class ProfilerAppTimerIndex
+ *
+ * This class assigns a dense index to each static timer during static initialization.
+ * The index allows the timer to be found without searching the hash table.
+ */
+template<uint64_t id, bool fixedMessage = true>
+class ProfilerAppTimerIndex final
+{
+public:
+    static inline const uint32_t index = ProfilerApp::registerTimer( id );
+};
+template<uint64_t id>
+class ProfilerAppTimerIndex<id, false> final
+{
+public:
+    static constexpr uint32_t index = 0;
+};
+
+
 /** \class ProfilerAppTimer
  *
  * This class provides a timer that automatically stops when it
@@ -16,9 +35,9 @@
  *    }
  */
 #if TIMER_CXX_STD < 20
-template<std::size_t id, bool fixedMessage = true>
+template<std::size_t id, bool fixedMessage = true, bool enabled = true>
 #else
-template<bool fixedMessage = true>
+template<bool fixedMessage = true, bool enabled = true>
 #endif
 class ProfilerAppTimer final
 {
@@ -27,7 +46,8 @@ public:
      * @brief Create and start a scoped profiler
      * @details This is constructor to create and start a timer that starts
      *    at the given line, and is automatically deleted.
-     *    The scoped timer is also recursive safe.
+     *    The scoped timer is also recursive safe.  If the timer is not enabled (the level
+     *    exceeds TIMER_MAX_LEVEL) the timer does nothing and is removed by the compiler.
      * @param[in] msg       Name of the timer
      * @param[in] file      Name of the file containing the code (__FILE__)
      * @param[in] line      Line number containing the start command (__LINE__)
@@ -42,14 +62,17 @@ public:
     explicit ProfilerAppTimer( const char* msg, const char* file, int line, int level, int trace )
         : d_traceFlag( trace ), d_trace( nullptr )
     {
-        if ( level >= 0 && level <= ProfilerApp::getLevel() ) {
-            if constexpr ( fixedMessage ) {
-                auto timer = ProfilerApp::getBlock( id, msg, file, line, true, true );
-                d_trace    = ProfilerApp::start( timer );
-            } else {
-                auto id2   = id ^ static_cast<uint64_t>( ProfilerApp::hashString( msg ) );
-                auto timer = ProfilerApp::getBlock( id2, msg, file, line, false, true );
-                d_trace    = ProfilerApp::start( timer );
+        if constexpr ( enabled ) {
+            if ( level >= 0 && level <= ProfilerApp::getLevel() ) {
+                if constexpr ( fixedMessage ) {
+                    auto index = ProfilerAppTimerIndex<id>::index;
+                    auto timer = ProfilerApp::getStaticBlock( index, id, msg, file, line );
+                    d_trace    = ProfilerApp::start( timer );
+                } else {
+                    auto id2   = id ^ static_cast<uint64_t>( ProfilerApp::hashString( msg ) );
+                    auto timer = ProfilerApp::getBlock( id2, msg, file, line, false, true );
+                    d_trace    = ProfilerApp::start( timer );
+                }
             }
         }
     }
@@ -58,37 +81,43 @@ public:
         : d_traceFlag( trace ), d_trace( nullptr )
     {
         static_assert( !fixedMessage );
-        if ( level >= 0 && level <= ProfilerApp::getLevel() ) {
-            auto id2   = id ^ static_cast<uint64_t>( ProfilerApp::hashString( msg.data() ) );
-            auto timer = ProfilerApp::getBlock( id2, msg.data(), file, line, false, true );
-            d_trace    = ProfilerApp::start( timer );
+        if constexpr ( enabled ) {
+            if ( level >= 0 && level <= ProfilerApp::getLevel() ) {
+                auto id2   = id ^ static_cast<uint64_t>( ProfilerApp::hashString( msg.data() ) );
+                auto timer = ProfilerApp::getBlock( id2, msg.data(), file, line, false, true );
+                d_trace    = ProfilerApp::start( timer );
+            }
         }
     }
 #else
-    explicit ProfilerAppTimer(
-        uint64_t id, const char* msg, const char* file, int line, int level, int trace )
+    explicit ProfilerAppTimer( uint64_t id, uint32_t index, const char* msg, const char* file,
+        int line, int level, int trace )
         : d_traceFlag( trace ), d_trace( nullptr )
     {
-        if ( level >= 0 && level <= ProfilerApp::getLevel() ) {
-            if constexpr ( fixedMessage ) {
-                auto timer = ProfilerApp::getBlock( id, msg, file, line, true, true );
-                d_trace    = ProfilerApp::start( timer );
-            } else {
-                auto id2   = id ^ static_cast<uint64_t>( ProfilerApp::hashString( msg ) );
-                auto timer = ProfilerApp::getBlock( id2, msg, file, line, false, true );
-                d_trace    = ProfilerApp::start( timer );
+        if constexpr ( enabled ) {
+            if ( level >= 0 && level <= ProfilerApp::getLevel() ) {
+                if constexpr ( fixedMessage ) {
+                    auto timer = ProfilerApp::getStaticBlock( index, id, msg, file, line );
+                    d_trace    = ProfilerApp::start( timer );
+                } else {
+                    auto id2   = id ^ static_cast<uint64_t>( ProfilerApp::hashString( msg ) );
+                    auto timer = ProfilerApp::getBlock( id2, msg, file, line, false, true );
+                    d_trace    = ProfilerApp::start( timer );
+                }
             }
         }
     }
-    explicit ProfilerAppTimer(
-        uint64_t id, const std::string& msg, const char* file, int line, int level, int trace )
+    explicit ProfilerAppTimer( uint64_t id, uint32_t, const std::string& msg, const char* file,
+        int line, int level, int trace )
         requires( !fixedMessage )
         : d_traceFlag( trace ), d_trace( nullptr )
     {
-        if ( level >= 0 && level <= ProfilerApp::getLevel() ) {
-            auto id2   = id ^ static_cast<uint64_t>( ProfilerApp::hashString( msg.data() ) );
-            auto timer = ProfilerApp::getBlock( id2, msg.data(), file, line, false, true );
-            d_trace    = ProfilerApp::start( timer );
+        if constexpr ( enabled ) {
+            if ( level >= 0 && level <= ProfilerApp::getLevel() ) {
+                auto id2   = id ^ static_cast<uint64_t>( ProfilerApp::hashString( msg.data() ) );
+                auto timer = ProfilerApp::getBlock( id2, msg.data(), file, line, false, true );
+                d_trace    = ProfilerApp::start( timer );
+            }
         }
     }
 #endif
@@ -96,8 +125,13 @@ public:
     //! Destructor
     ~ProfilerAppTimer()
     {
-        if ( d_trace && ProfilerApp::getLevel() >= 0 )
-            ProfilerApp::stop( d_trace, std::chrono::steady_clock::now(), d_traceFlag );
+        if constexpr ( enabled ) {
+            if ( d_trace && ProfilerApp::getLevel() >= 0 ) {
+                // Throttled calls are not timed (skip reading the clock)
+                uint64_t time = d_trace->timed() ? ProfilerApp::getTime() : 0;
+                ProfilerApp::stop( d_trace, time, d_traceFlag );
+            }
+        }
     }
 
     ProfilerAppTimer( const ProfilerAppTimer& )            = delete;
@@ -7,14 +7,24 @@
 #define _COUNT_ARGS( ... ) _ARG_PATTERN_MATCH( __VA_ARGS__, 9, 8, 7, 6, 5, 4, 3, 2, 1 )
 #define _ARG_PATTERN_MATCH( _1, _2, _3, _4, _5, _6, _7, _8, _9, N, ... ) N
 
+// Check if a timer level is compiled (requires a constant level if TIMER_MAX_LEVEL is set)
+#ifdef TIMER_MAX_LEVEL
+#define PROFILE_LEVEL_ENABLED( LEVEL ) ( ( LEVEL ) <= TIMER_MAX_LEVEL )
+#else
+#define PROFILE_LEVEL_ENABLED( LEVEL ) true
+#endif
+
 // Define some helper functions
 #define PROFILE_ID( NAME ) ProfilerApp::getTimerId( NAME, __FILE__, __LINE__ )
 #if TIMER_CXX_STD < 20
-#define CALL_STATIC_TIMER_VAR( VAR, ID, FIXED, NAME, LEVEL, TRACE ) \
-    ProfilerAppTimer<ID, FIXED> VAR( NAME, __FILE__, __LINE__, LEVEL, TRACE )
+#define CALL_STATIC_TIMER_VAR( VAR, ID, FIXED, NAME, LEVEL, TRACE )                  \
+    ProfilerAppTimer<ID, FIXED, PROFILE_LEVEL_ENABLED( LEVEL )> VAR( NAME, __FILE__, \
+        __LINE__, LEVEL, TRACE )
 #else
-#define CALL_STATIC_TIMER_VAR( VAR, ID, FIXED, NAME, LEVEL, TRACE ) \
-    ProfilerAppTimer<FIXED> VAR( ID, NAME, __FILE__, __LINE__, LEVEL, TRACE )
+#define CALL_STATIC_TIMER_VAR( VAR, ID, FIXED, NAME, LEVEL, TRACE )                      \
+    ProfilerAppTimer<FIXED, PROFILE_LEVEL_ENABLED( LEVEL )> VAR( ID,                     \
+        ProfilerAppTimerIndex<ID, FIXED && PROFILE_LEVEL_ENABLED( LEVEL )>::index, NAME, \
+        __FILE__, __LINE__, LEVEL, TRACE )
 #endif
 #define CALL_STATIC_TIMER( ID_NAME, FIXED, NAME, LINE, LEVEL, TRACE ) \
     CALL_STATIC_TIMER_VAR( profile_##LINE, PROFILE_ID( ID_NAME ), FIXED, NAME, LEVEL, TRACE )
@@ -1,6 +1,8 @@
 #ifndef included_ProfilerAppMacros
 #define included_ProfilerAppMacros
 
+#include "ProfilerDefinitions.h"
+
 
 // Define some C interfaces to the global profiler
 extern void global_profiler_nullUse( void* );
@@ -15,16 +17,23 @@ extern void global_profiler_stop( const char* name, const char* file, int level
 extern void global_profiler_save( const char* name, int global );
 
 
+// Check if a timer level is compiled (timers above TIMER_MAX_LEVEL are removed)
+#ifdef TIMER_MAX_LEVEL
+#define PROFILE_LEVEL_ENABLED( LEVEL ) ( ( (int) LEVEL ) <= TIMER_MAX_LEVEL )
+#else
+#define PROFILE_LEVEL_ENABLED( LEVEL ) 1
+#endif
+
 // Define some helper macros
-#define PROFILE_START_LEVEL( FILE, LINE, NAME, LEVEL, ... )   \
-    do {                                                      \
-        if ( ( (int) LEVEL ) <= global_profiler_get_level() ) \
-            global_profiler_start( NAME, FILE, LINE, LEVEL ); \
+#define PROFILE_START_LEVEL( FILE, LINE, NAME, LEVEL, ... )                                     \
+    do {                                                                                        \
+        if ( PROFILE_LEVEL_ENABLED( LEVEL ) && ( (int) LEVEL ) <= global_profiler_get_level() ) \
+            global_profiler_start( NAME, FILE, LINE, LEVEL );                                   \
     } while ( 0 )
-#define PROFILE_STOP_LEVEL( FILE, LINE, NAME, LEVEL, ... ) \
-    do {                                                   \
-        if ( LEVEL <= global_profiler_get_level() )        \
-            global_profiler_stop( NAME, FILE, LEVEL );     \
+#define PROFILE_STOP_LEVEL( FILE, LINE, NAME, LEVEL, ... )                            \
+    do {                                                                              \
+        if ( PROFILE_LEVEL_ENABLED( LEVEL ) && LEVEL <= global_profiler_get_level() ) \
+            global_profiler_stop( NAME, FILE, LEVEL );                                \
     } while ( 0 )
 #define PROFILE_SAVE_GLOBAL( NAME, GLOB, ... ) global_profiler_save( NAME, GLOB )
 
@@ -275,6 +275,10 @@ MACRO( CONFIGURE_TIMER )
     ELSE()
         FILE( APPEND "${${PROJ}_INSTALL_DIR}/include/ProfilerDefinitions.h" "#define TIMER_ENABLE_NEW_OVERLOAD\n" )
     ENDIF()
+    # Set the maximum timer level to compile (timers above this level are removed at compile time)
+    IF ( DEFINED TIMER_MAX_LEVEL )
+        FILE( APPEND "${${PROJ}_INSTALL_DIR}/include/ProfilerDefinitions.h" "#ifndef TIMER_MAX_LEVEL\n#define TIMER_MAX_LEVEL ${TIMER_MAX_LEVEL}\n#endif\n" )
+    ENDIF()
     # Disable CMake warning for unused flags
     NULL_USE( QWT_SRC_DIR )
     NULL_USE( QWT_URL )
@@ -10,15 +10,21 @@
 
 // Struct to hold the summary info for a trace
 struct TraceSummary {
-    id_struct id;           //!<  Timer ID
-    uint64_t stack;         //!<  Calling stack
-    uint64_t stack2;        //!<  Stack including this trace
-    std::set<int> threads;  //!<  Threads that are active for this timer
-    std::vector<int> N;     //!<  Number of calls
-    std::vector<float> min; //!<  Minimum time
-    std::vector<float> max; //!<  Maximum time
-    std::vector<float> tot; //!<  Total time
-    TraceSummary() {}
+    id_struct id;               //!<  Timer ID
+    uint64_t stack;             //!<  Calling stack
+    uint64_t stack2;            //!<  Stack including this trace
+    std::set<int> threads;      //!<  Threads that are active for this timer
+    std::vector<int> N;         //!<  Number of calls
+    std::vector<float> min;     //!<  Minimum time
+    std::vector<float> max;     //!<  Maximum time
+    std::vector<float> tot;     //!<  Total time
+    std::vector<float> self;    //!<  Exclusive time
+    std::vector<float> cpu;     //!<  Thread CPU time
+    std::vector<float> perf[4]; //!<  Hardware performance counters
+    bool hasSelf;               //!<  Do we have the exclusive time (older files do not)
+    bool hasCPU;                //!<  Do we have the thread CPU time (optional)
+    bool hasPerf;               //!<  Do we have the hardware performance counters (optional)
+    TraceSummary() : hasSelf( true ), hasCPU( true ), hasPerf( true ) {}
     ~TraceSummary() {}
 };
 
@@ -34,6 +40,8 @@ struct TimerSummary {
     std::vector<float> min;                  //!<  Minimum time
     std::vector<float> max;                  //!<  Maximum time
     std::vector<float> tot;                  //!<  Total time
+    std::vector<float> cpu;                  //!<  Thread CPU time (inclusive)
+    std::vector<float> perf[4];              //!<  Hardware performance counters (inclusive)
     std::vector<const TraceSummary *> trace; //!< List of all active traces for the timer
     TimerSummary() : line( -1 ) {}
     ~TimerSummary() {}
@@ -11,6 +11,7 @@
 #include <QStatusBar>
 #include <QtGui>
 
+#include <algorithm>
 #include <limits>
 #include <memory>
 #include <set>
@@ -361,8 +362,8 @@ void TimerWindow::loadFile( std::string filename, bool showFailure )
         {
             PROFILE( "ProfilerApp::load" );
             try {
-                // Load the timer data
-                d_data = ProfilerApp::load( filename, -1, global );
+                // Load the timer data (the trace data is read from the file when it is used)
+                d_data = ProfilerApp::load( filename, -1, global, true );
             } catch ( std::exception& e ) {
                 if ( showFailure ) {
                     std::string msg = e.what();
@@ -435,6 +436,10 @@ void TimerWindow::loadFile( std::string filename, bool showFailure )
                     d_dataTrace[k]->min.resize( N_procs, 1e30 );
                     d_dataTrace[k]->max.resize( N_procs, 0 );
                     d_dataTrace[k]->tot.resize( N_procs, 0 );
+                    d_dataTrace[k]->self.resize( N_procs, 0 );
+                    d_dataTrace[k]->cpu.resize( N_procs, 0 );
+                    for ( auto& perf : d_dataTrace[k]->perf )
+                        perf.resize( N_procs, 0 );
                     timer.trace.push_back( d_dataTrace[k].get() );
                 }
                 auto* trace = const_cast<TraceSummary*>( timer.trace[index] );
@@ -444,6 +449,13 @@ void TimerWindow::loadFile( std::string filename, bool showFailure )
                 trace->min[rank] = std::min( trace->min[rank], 1e-9f * t0.min );
                 trace->max[rank] = std::max( trace->max[rank], 1e-9f * t0.max );
                 trace->tot[rank] += 1e-9f * t0.tot;
+                trace->self[rank] += 1e-9f * t0.self;
+                trace->cpu[rank] += 1e-9f * t0.cpu;
+                for ( int j = 0; j < 4; j++ )
+                    trace->perf[j][rank] += t0.perf[j];
+                trace->hasSelf = trace->hasSelf && t0.self >= 0;
+                trace->hasCPU  = trace->hasCPU && t0.cpu >= 0;
+                trace->hasPerf = trace->hasPerf && t0.perf_set == 1;
             }
             std::set<int> ids;
             for ( size_t j = 0; j < timer.trace.size(); j++ ) {
@@ -509,10 +521,11 @@ void TimerWindow::loadFile( std::string filename, bool showFailure )
  ***********************************************************************/
 bool TimerWindow::hasTraceData() const
 {
+    // The slowest calls are shown in the trace window even without the detailed trace data
     bool traceData = false;
     for ( const auto& timer : d_data.timers ) {
         for ( const auto& j : timer.trace )
-            traceData = traceData || j.N_trace > 0;
+            traceData = traceData || j.N_trace > 0 || j.slow;
     }
     return traceData;
 }
@@ -587,11 +600,12 @@ void TimerWindow::updateDisplay()
     // Fill the table data
     QStringList TableHeader;
     TableHeader << "id" << "Message" << "Filename" << "Line" << "Thread" << "N calls" << "min time"
-                << "max time" << "total time" << "% time";
+                << "max time" << "total time" << "% time" << "cpu time" << "wait time" << "IPC"
+                << "cache misses" << "branch misses";
     timerTable->clear();
     timerTable->setRowCount( 0 );
     timerTable->setRowCount( current_timers.size() );
-    timerTable->setColumnCount( 10 );
+    timerTable->setColumnCount( 15 );
     timerTable->QTableView::setColumnHidden( 0, true );
     timerTable->setColumnWidth( 1, 200 );
     timerTable->setColumnWidth( 2, 200 );
@@ -602,18 +616,43 @@ void TimerWindow::updateDisplay()
     timerTable->setColumnWidth( 7, 95 );
     timerTable->setColumnWidth( 8, 95 );
     timerTable->setColumnWidth( 9, 85 );
+    timerTable->setColumnWidth( 10, 95 );
+    timerTable->setColumnWidth( 11, 95 );
+    timerTable->setColumnWidth( 12, 60 );
+    timerTable->setColumnWidth( 13, 95 );
+    timerTable->setColumnWidth( 14, 95 );
     timerTable->setHorizontalHeaderLabels( TableHeader );
     timerTable->verticalHeader()->setVisible( false );
     timerTable->setEditTriggers( QAbstractItemView::NoEditTriggers );
     size_t N_timers = current_timers.size();
     std::vector<int> N_data( N_timers );
     std::vector<double> min_data( N_timers ), max_data( N_timers ), tot_data( N_timers );
+    std::vector<double> cpu_data( N_timers ), ipc_data( N_timers );
+    std::vector<double> cache_data( N_timers ), branch_data( N_timers );
+    bool hasCPU  = inclusiveTime; // The CPU time is inclusive
+    bool hasPerf = inclusiveTime; // The performance counters are inclusive
     for ( size_t i = 0; i < N_timers; i++ ) {
         N_data[i]   = getTableData( current_timers[i]->N, selected_rank );
         min_data[i] = getTableData( current_timers[i]->min, selected_rank );
         max_data[i] = getTableData( current_timers[i]->max, selected_rank );
         tot_data[i] = getTableData( current_timers[i]->tot, selected_rank );
+        cpu_data[i] = getTableData( current_timers[i]->cpu, selected_rank );
+        // Get the instructions per cycle and the misses per call
+        double inst    = getTableData( current_timers[i]->perf[0], selected_rank );
+        double cycles  = getTableData( current_timers[i]->perf[1], selected_rank );
+        double N_calls = std::max( N_data[i], 1 );
+        ipc_data[i]    = cycles > 0 ? inst / cycles : 0;
+        cache_data[i]  = getTableData( current_timers[i]->perf[2], selected_rank ) / N_calls;
+        branch_data[i] = getTableData( current_timers[i]->perf[3], selected_rank ) / N_calls;
+        for ( auto trace : current_timers[i]->trace ) {
+            hasCPU  = hasCPU && trace->hasCPU;
+            hasPerf = hasPerf && trace->hasPerf;
+        }
     }
+    timerTable->QTableView::setColumnHidden( 10, !hasCPU );
+    timerTable->QTableView::setColumnHidden( 11, !hasCPU );
+    for ( int col = 12; col < 15; col++ )
+        timerTable->QTableView::setColumnHidden( col, !hasPerf );
     double tot_max = d_data.walltime;
     if ( !d_callStack.empty() )
         tot_max = max( tot_data );
@@ -633,6 +672,11 @@ void TimerWindow::updateDisplay()
         auto max     = new TableValue( max_data[i], "%0.3e" );
         auto total   = new TableValue( tot_data[i], "%0.3e" );
         auto percent = new TableValue( 100 * ratio[i], "%0.2f" );
+        auto cpu     = new TableValue( cpu_data[i], "%0.3e" );
+        auto wait    = new TableValue( std::max( tot_data[i] - cpu_data[i], 0.0 ), "%0.3e" );
+        auto ipc     = new TableValue( ipc_data[i], "%0.2f" );
+        auto cache   = new TableValue( cache_data[i], "%0.3e" );
+        auto branch  = new TableValue( branch_data[i], "%0.3e" );
         id->setTextAlignment( Qt::AlignHCenter | Qt::AlignVCenter );
         message->setTextAlignment( Qt::AlignLeft | Qt::AlignVCenter );
         file->setTextAlignment( Qt::AlignLeft | Qt::AlignVCenter );
@@ -643,6 +687,11 @@ void TimerWindow::updateDisplay()
         max->setTextAlignment( Qt::AlignLeft | Qt::AlignVCenter );
         total->setTextAlignment( Qt::AlignLeft | Qt::AlignVCenter );
         percent->setTextAlignment( Qt::AlignHCenter | Qt::AlignVCenter );
+        cpu->setTextAlignment( Qt::AlignLeft | Qt::AlignVCenter );
+        wait->setTextAlignment( Qt::AlignLeft | Qt::AlignVCenter );
+        ipc->setTextAlignment( Qt::AlignHCenter | Qt::AlignVCenter );
+        cache->setTextAlignment( Qt::AlignLeft | Qt::AlignVCenter );
+        branch->setTextAlignment( Qt::AlignLeft | Qt::AlignVCenter );
         timerTable->setItem( i, 0, id );
         timerTable->setItem( i, 1, message );
         timerTable->setItem( i, 2, file );
@@ -653,9 +702,14 @@ void TimerWindow::updateDisplay()
         timerTable->setItem( i, 7, max );
         timerTable->setItem( i, 8, total );
         timerTable->setItem( i, 9, percent );
+        timerTable->setItem( i, 10, cpu );
+        timerTable->setItem( i, 11, wait );
+        timerTable->setItem( i, 12, ipc );
+        timerTable->setItem( i, 13, cache );
+        timerTable->setItem( i, 14, branch );
     }
     timerTable->setSortingEnabled( true );
-    timerTable->sortItems( 10, Qt::DescendingOrder );
+    timerTable->sortItems( 8, Qt::DescendingOrder );
     timerTable->show();
     // Update the load balance plot
     if ( N_procs > 1 && !current_timers.empty() ) {
@@ -714,6 +768,9 @@ std::vector<std::unique_ptr<TimerSummary>> TimerWindow::getTimers() const
         timer->min.resize( N_procs, 1e100 );
         timer->max.resize( N_procs, 0.0 );
         timer->tot.resize( N_procs, 0.0 );
+        timer->cpu.resize( N_procs, 0.0 );
+        for ( auto& perf : timer->perf )
+            perf.resize( N_procs, 0.0 );
         std::set<int> threads;
         for ( const auto& trace : timer->trace ) {
             threads.insert( trace->threads.begin(), trace->threads.end() );
@@ -722,12 +779,30 @@ std::vector<std::unique_ptr<TimerSummary>> TimerWindow::getTimers() const
                 timer->min[k] = std::min<double>( timer->min[k], trace->min[k] );
                 timer->max[k] = std::max<double>( timer->max[k], trace->max[k] );
                 timer->tot[k] += trace->tot[k];
+                timer->cpu[k] += trace->cpu[k];
+                for ( int j = 0; j < 4; j++ )
+                    timer->perf[j][k] += trace->perf[j][k];
             }
         }
         timer->threads = std::vector<int>( threads.begin(), threads.end() );
     }
-    // Update the timers to remove the time from sub-timers if necessary
-    if ( !inclusiveTime ) {
+    // Use the exclusive time stored by the profiler if it is available
+    bool hasSelf = true;
+    for ( const auto& timer : timers ) {
+        for ( const auto& trace : timer->trace )
+            hasSelf = hasSelf && trace->hasSelf;
+    }
+    if ( !inclusiveTime && hasSelf ) {
+        for ( auto& timer : timers ) {
+            std::fill( timer->tot.begin(), timer->tot.end(), 0.0 );
+            for ( const auto& trace : timer->trace ) {
+                for ( int k = 0; k < N_procs; k++ )
+                    timer->tot[k] += trace->self[k];
+            }
+        }
+    }
+    // Update the timers to remove the time from sub-timers if necessary (older files)
+    if ( !inclusiveTime && !hasSelf ) {
         PROFILE( "getTimers-removeSubtimers", 1 );
         for ( auto& timer2 : timers ) {
             for ( auto& trace2 : timer2->trace ) {
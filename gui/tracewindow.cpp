@@ -20,6 +20,7 @@
 #include <set>
 #include <sstream>
 #include <thread>
+#include <tuple>
 #include <vector>
 
 #include "MemoryPlot.h"
@@ -195,6 +196,13 @@ TraceWindow::TraceWindow( const TimerWindow *parent_ )
     t_current = t_global;
     resize( 1200, 800 );
 
+    // Index the trace data so we only decode the calls in the current time range
+    traceIndex.resize( parent->d_data.timers.size() );
+    for ( size_t i = 0; i < traceIndex.size(); i++ ) {
+        for ( const auto &trace : parent->d_data.timers[i].trace )
+            traceIndex[i].push_back( trace.indexTimes() );
+    }
+
     // Create the master timeline
     timeline = new QLabel;
     timeline->setScaledContents( true );
@@ -262,6 +270,7 @@ TraceWindow::TraceWindow( const TimerWindow *parent_ )
 TraceWindow::~TraceWindow()
 {
     qApp->processEvents();
+    delete slowestButtonMenu;
     delete threadButtonMenu;
     delete processorButtonMenu;
 }
@@ -332,6 +341,10 @@ std::vector<std::unique_ptr<TimerTimeline>> TraceWindow::getTraceData(
     const double t0 = t[0];
     const double t1 = t[1];
     const double dt = ( t[1] - t[0] ) / ( resolution - 1 );
+    // Time range in ns (rounded out) for decoding the trace data
+    auto t0_ns = static_cast<uint64_t>( std::max( 1e9 * t0, 0.0 ) );
+    auto t1_ns = static_cast<uint64_t>( std::max( 1e9 * t1, 0.0 ) ) + 1;
+    std::vector<uint64_t> start, stop;
     for ( size_t i = 0; i < timers.size(); i++ ) {
         data[i].reset( new TimerTimeline );
         data[i]->id      = timers[i].id;
@@ -343,21 +356,17 @@ std::vector<std::unique_ptr<TimerTimeline>> TraceWindow::getTraceData(
         for ( size_t j = 0; j < timers[i].trace.size(); j++ ) {
             const int rank   = timers[i].trace[j].rank;
             const int thread = timers[i].trace[j].thread;
-            uint32_t N_trace = timers[i].trace[j].N_trace;
             if ( selected_thread != -1 && thread != selected_thread )
                 continue;
             if ( selected_rank != -1 && rank != selected_rank )
                 continue;
-            const int it  = Nt == 1 ? 0 : thread;
-            const int ip  = Np == 1 ? 0 : rank;
-            uint64_t last = 0;
-            for ( size_t k = 0; k < N_trace; k++ ) {
-                uint64_t start = last + timers[i].trace[j].times[2 * k + 0];
-                uint64_t stop  = start + timers[i].trace[j].times[2 * k + 1];
-                last           = stop;
-                double s1      = 1e-9 * start;
-                double s2      = 1e-9 * stop;
-                if ( s2 <= t0 || s1 >= t1 || start == stop )
+            const int it = Nt == 1 ? 0 : thread;
+            const int ip = Np == 1 ? 0 : rank;
+            timers[i].trace[j].getTimes( traceIndex[i][j], t0_ns, t1_ns, start, stop );
+            for ( size_t k = 0; k < start.size(); k++ ) {
+                double s1 = 1e-9 * start[k];
+                double s2 = 1e-9 * stop[k];
+                if ( s2 <= t0 || s1 >= t1 || start[k] == stop[k] )
                     continue;
                 int m1 = std::max<int>( ( s1 - t0 ) / dt, 0 );
                 int m2 = std::min<int>( ( s2 - t0 ) / dt, resolution - 1 );
@@ -617,6 +626,15 @@ void TraceWindow::moveTimelineWindow( int index, double t )
     t_current = t_new;
     updateDisplay( UpdateType::time );
 }
+void TraceWindow::selectSlowest( int index )
+{
+    // Zoom to the call (with the duration of the call on either side)
+    auto t       = slowestCalls[index];
+    double dt    = t[1] - t[0];
+    t_current[0] = std::max( t[0] - dt, t_global[0] );
+    t_current[1] = std::min( t[1] + dt, t_global[1] );
+    updateDisplay( UpdateType::time );
+}
 
 
 /***********************************************************************
@@ -669,6 +687,37 @@ void TraceWindow::createToolBars()
     threadButton->setMenu( threadButtonMenu );
     toolBar->addSeparator();
 
+    // Slowest calls popup (jump to the call)
+    toolBar->addSeparator();
+    slowestButton = new QToolButton();
+    slowestButton->setPopupMode( QToolButton::InstantPopup );
+    toolBar->addWidget( slowestButton );
+    slowestButtonMenu = new QMenu();
+    signalMapper      = new QSignalMapper( this );
+    std::vector<std::tuple<uint64_t, uint64_t, const TimerResults *, const TraceResults *>> slow;
+    for ( const auto &timer : parent->d_data.timers ) {
+        for ( const auto &trace : timer.trace ) {
+            for ( int i = 0; trace.slow && i < TraceResults::SLOW_SIZE; i++ ) {
+                if ( trace.slow[2 * i + 1] > 0 )
+                    slow.emplace_back( trace.slow[2 * i + 1], trace.slow[2 * i], &timer, &trace );
+            }
+        }
+    }
+    std::sort( slow.rbegin(), slow.rend() );
+    slow.resize( std::min<size_t>( slow.size(), 20 ) );
+    for ( size_t i = 0; i < slow.size(); i++ ) {
+        auto [ns, start, timer, trace] = slow[i];
+        auto label = stringf( "%s: %0.3f ms (rank %i, thread %i)", timer->message, 1e-6 * ns,
+            trace->rank, trace->thread );
+        ADD_MENU_ACTION( slowestButtonMenu, label.c_str(), static_cast<int>( i ) );
+        slowestCalls.push_back( { 1e-9 * start, 1e-9 * ( start + ns ) } );
+    }
+    connect( signalMapper, SIGNAL( mapped( int ) ), this, SLOT( selectSlowest( int ) ) );
+    slowestButton->setText( "Slowest calls" );
+    slowestButton->setMenu( slowestButtonMenu );
+    slowestButton->setEnabled( !slowestCalls.empty() );
+    toolBar->addSeparator();
+
     // Resolution
     QAction *tmp = toolBar->addAction( "Resolution:" );
     tmp->setCheckable( false );
@@ -691,15 +740,21 @@ std::array<double, 2> TraceWindow::getGlobalTime( const std::vector<TimerResults
     t_global[1] = -1e100;
     for ( const auto &timer : timers ) {
         for ( const auto &trace : timer.trace ) {
-            const int N_trace = trace.N_trace;
-            uint64_t last     = 0;
-            for ( int k = 0; k < N_trace; k++ ) {
-                uint64_t start = last + trace.times[2 * k + 0];
-                uint64_t stop  = start + trace.times[2 * k + 1];
-                last           = stop;
-                t_global[0]    = std::min( t_global[0], 1e-9 * start );
-                t_global[1]    = std::max( t_global[1], 1e-9 * stop );
+            // Include the slowest calls (stored without the detailed trace data)
+            for ( int i = 0; trace.slow && i < TraceResults::SLOW_SIZE; i++ ) {
+                uint64_t start = trace.slow[2 * i];
+                uint64_t ns    = trace.slow[2 * i + 1];
+                if ( ns == 0 )
+                    continue;
+                t_global[0] = std::min( t_global[0], 1e-9 * start );
+                t_global[1] = std::max( t_global[1], 1e-9 * ( start + ns ) );
             }
+            if ( trace.N_trace == 0 )
+                continue;
+            // The calls are sorted so we only need the first start and last stop
+            auto range  = trace.getTimeRange();
+            t_global[0] = std::min( t_global[0], 1e-9 * range[0] );
+            t_global[1] = std::max( t_global[1], 1e-9 * range[1] );
         }
     }
     return t_global;
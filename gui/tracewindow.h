@@ -45,6 +45,7 @@ private slots:
     void resizeDone();
     void selectProcessor( int );
     void selectThread( int );
+    void selectSlowest( int );
     void resolutionChanged();
 
 private:
@@ -62,9 +63,11 @@ private:
     QTimer resizeTimer;
     QToolButton *processorButton;
     QToolButton *threadButton;
+    QToolButton *slowestButton;
     QLineEdit *resolutionBox;
     QMenu *processorButtonMenu;
     QMenu *threadButtonMenu;
+    QMenu *slowestButtonMenu;
     std::vector<QLabel *> timerLabels;
     std::vector<QLabelMouse *> timerPlots;
     std::unique_ptr<CurrentTimeLineClass> timelineBoundaries[2];
@@ -80,7 +83,9 @@ private:
     int resolution;
     int selected_rank;
     int selected_thread;
+    std::vector<std::vector<std::vector<TraceResults::TimesIndex>>> traceIndex;
     std::map<id_struct, uint32_t> idRgbMap;
+    std::vector<std::array<double, 2>> slowestCalls;
     std::unique_ptr<QPixmap> timelinePixelMap;
 
     bool traceZoomActive;
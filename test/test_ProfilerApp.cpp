@@ -1,7 +1,12 @@
+// Remove timers above level 2 at compile time
+#define TIMER_MAX_LEVEL 2
+
 #include "MemoryApp.h"
 #include "ProfilerApp.h"
 #include "test_Helpers.h"
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cmath>
 #include <cstdlib>
@@ -281,6 +286,599 @@ bool compareTimers( const std::vector<TimerResults> &x, const std::vector<TimerR
 }
 
 
+// Check that the TSC clock (if available) agrees with steady_clock
+int test_clock_source()
+{
+    int N_errors = 0;
+    ProfilerApp::setClockSource( ProfilerApp::ClockSource::TSC );
+    bool tsc = ProfilerApp::getClockSource() == ProfilerApp::ClockSource::TSC;
+    if ( getRank() == 0 )
+        printf( "TSC clock: %s\n\n", tsc ? "enabled" : "not available" );
+    PROFILE_ENABLE();
+    {
+        PROFILE( "sleep (clock)" );
+        std::this_thread::sleep_for( std::chrono::milliseconds( 200 ) );
+    }
+    auto t1 = ProfilerApp::getTime();
+    std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+    auto t2 = ProfilerApp::getTime();
+    for ( auto &timer : ProfilerApp::getTimerResults() ) {
+        double tot = 1e-9 * timer.trace[0].tot;
+        if ( fabs( tot - 0.2 ) > 0.02 ) {
+            std::cout << "Error profiling sleep with clock source: " << tot << std::endl;
+            N_errors++;
+        }
+    }
+    if ( t2 <= t1 || fabs( 1e-9 * ( t2 - t1 ) - 0.05 ) > 0.01 ) {
+        std::cout << "Error in getTime: " << t2 - t1 << std::endl;
+        N_errors++;
+    }
+    PROFILE_DISABLE();
+    ProfilerApp::setClockSource( ProfilerApp::ClockSource::Steady );
+    return N_errors;
+}
+
+
+// Check that timers above TIMER_MAX_LEVEL are removed
+int test_max_level()
+{
+    int N_errors = 0;
+    PROFILE_ENABLE( 3 );
+    {
+        PROFILE( "level 2 (max level)", 2 );
+        PROFILE( "level 3 (max level)", 3 );
+    }
+    auto timers = ProfilerApp::getTimerResults();
+    if ( timers.size() != 1 || strcmp( timers[0].message, "level 2 (max level)" ) != 0 ) {
+        std::cout << "Error with TIMER_MAX_LEVEL\n";
+        N_errors++;
+    }
+    PROFILE_DISABLE();
+    return N_errors;
+}
+
+
+// Check that a hot timer is throttled when it exceeds the overhead budget
+int test_throttle()
+{
+    int N_errors = 0;
+    PROFILE_ENABLE();
+    ProfilerApp::setOverheadBudget( 0.001 );
+    const int N = 1000000;
+    for ( int i = 0; i < N; i++ ) {
+        PROFILE( "hot (throttle)" );
+    }
+    ProfilerApp::setOverheadBudget( 0 );
+    auto timers = ProfilerApp::getTimerResults();
+    if ( timers.size() != 1 || timers[0].trace[0].N != N ||
+         timers[0].trace[0].N_timed >= timers[0].trace[0].N ) {
+        std::cout << "Error throttling hot timer\n";
+        N_errors++;
+    }
+    PROFILE_DISABLE();
+    return N_errors;
+}
+
+
+// Check the percentiles and standard deviation of the call times
+int test_histogram()
+{
+    int N_errors = 0;
+    PROFILE_ENABLE();
+    ProfilerApp::setStoreHistogram( true );
+    for ( int i = 0; i < 100; i++ ) {
+        PROFILE( "histogram" );
+        if ( i % 10 == 0 )
+            std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
+    }
+    ProfilerApp::setStoreHistogram( false );
+    auto timers = ProfilerApp::getTimerResults();
+    double p50  = timers[0].percentile( 50 );
+    double p95  = timers[0].percentile( 95 );
+    double p100 = timers[0].percentile( 100 );
+    if ( p50 < 0 || p50 > 1e6 || p95 < 4e6 || p100 > timers[0].trace[0].max ) {
+        std::cout << "Error with histogram: " << p50 << " " << p95 << " " << p100 << std::endl;
+        N_errors++;
+    }
+    double stdev = timers[0].stdev(); // Expect ~1.5 ms
+    if ( stdev < 1e6 || stdev > 2e6 || fabs( stdev - timers[0].trace[0].stdev ) > 1e3 ) {
+        std::cout << "Error with standard deviation: " << stdev << std::endl;
+        N_errors++;
+    }
+    ProfilerApp::save( "test_histogram", false );
+    auto timers2 = ProfilerApp::load( "test_histogram", getRank(), false ).timers;
+    if ( timers2.size() != 1 || timers2[0].trace[0] != timers[0].trace[0] ) {
+        std::cout << "Error with saved histogram\n";
+        N_errors++;
+    }
+    PROFILE_DISABLE();
+    return N_errors;
+}
+
+
+// Check the slowest calls are captured without the detailed trace data
+int test_slowest()
+{
+    int N_errors = 0;
+    PROFILE_ENABLE();
+    ProfilerApp::setStoreSlowest( true );
+    for ( int i = 0; i < 1000; i++ ) {
+        PROFILE( "slowest" );
+        if ( i == 300 ) {
+            std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+        } else if ( i % 100 == 0 && i > 0 && i < 900 ) {
+            std::this_thread::sleep_for( std::chrono::milliseconds( 2 ) );
+        }
+    }
+    ProfilerApp::setStoreSlowest( false );
+    auto timers = ProfilerApp::getTimerResults();
+    auto slow   = timers[0].trace[0].slow;
+    bool pass   = slow != nullptr && timers[0].trace[0].N_trace == 0;
+    if ( pass ) {
+        // The 10 ms call is first (after 2 of the 2 ms calls), followed by the 2 ms calls
+        pass        = slow[1] >= 10000000;
+        int N_start = 0;
+        for ( int i = 1; i < TraceResults::SLOW_SIZE; i++ ) {
+            pass = pass && slow[2 * i + 1] >= 2000000 && slow[2 * i + 1] <= slow[2 * i - 1];
+            N_start += slow[2 * i] < slow[0] ? 1 : 0;
+        }
+        pass = pass && N_start == 2;
+    }
+    if ( !pass ) {
+        std::cout << "Error with the slowest calls\n";
+        N_errors++;
+    }
+    ProfilerApp::save( "test_slowest", false );
+    auto timers2 = ProfilerApp::load( "test_slowest", getRank(), false ).timers;
+    if ( timers2.size() != 1 || timers2[0].trace[0] != timers[0].trace[0] ) {
+        std::cout << "Error with saved slowest calls\n";
+        N_errors++;
+    }
+    PROFILE_DISABLE();
+    return N_errors;
+}
+
+
+// Check the CPU time of completed and running calls (including the saved results)
+static inline void spin( int ms )
+{
+    auto t0 = std::chrono::steady_clock::now();
+    while ( std::chrono::steady_clock::now() - t0 < std::chrono::milliseconds( ms ) ) {}
+}
+int test_cpu_time()
+{
+    int N_errors = 0;
+    PROFILE_ENABLE();
+    ProfilerApp::setStoreCPU( true );
+    if ( !ProfilerApp::getStoreCPU() ) {
+        PROFILE_DISABLE();
+        return 0; // The thread CPU time is not available
+    }
+    auto find = []( const std::vector<TimerResults> &timers, const char *msg ) {
+        static const TraceResults none;
+        for ( const auto &timer : timers ) {
+            if ( strcmp( timer.message, msg ) == 0 )
+                return &timer.trace[0];
+        }
+        return &none;
+    };
+    {
+        PROFILE( "cpu (sleep)" );
+        std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+        spin( 50 );
+    }
+    std::vector<TimerResults> timers;
+    {
+        PROFILE( "cpu (running)" );
+        spin( 50 );
+        timers = ProfilerApp::getTimerResults();
+    }
+    auto running = find( timers, "cpu (running)" );
+    if ( running->N != 1 || running->cpu < 1e7 || running->cpu > running->tot ) {
+        std::cout << "Error with CPU time for running call: " << running->cpu << std::endl;
+        N_errors++;
+    }
+    auto sleep = find( timers, "cpu (sleep)" );
+    if ( sleep->N != 1 || sleep->cpu < 1e7 || sleep->cpu > 0.8 * sleep->tot ) {
+        std::cout << "Error with CPU time for sleep: " << sleep->cpu << std::endl;
+        N_errors++;
+    }
+    ProfilerApp::save( "test_cpu", false );
+    auto timers2 = ProfilerApp::load( "test_cpu", getRank(), false ).timers;
+    auto sleep2  = find( timers2, "cpu (sleep)" );
+    if ( fabs( sleep2->cpu - sleep->cpu ) > 1e-5 * sleep->cpu ) {
+        std::cout << "Error with saved CPU time: " << sleep2->cpu << std::endl;
+        N_errors++;
+    }
+    ProfilerApp::setStoreCPU( false );
+    PROFILE_DISABLE();
+    return N_errors;
+}
+
+
+// Check the performance counters of the calls (including the saved results)
+int test_counters()
+{
+    int N_errors = 0;
+    PROFILE_ENABLE();
+    ProfilerApp::setStoreCounters( true );
+    auto set = static_cast<uint8_t>( ProfilerApp::getStoreCounters() );
+    if ( set == 0 ) {
+        PROFILE_DISABLE();
+        return 0; // The performance counters are not available
+    }
+    for ( int i = 0; i < 10; i++ ) {
+        PROFILE( "counters" );
+        spin( 2 );
+    }
+    ProfilerApp::setStoreCounters( false );
+    auto timers = ProfilerApp::getTimerResults();
+    ProfilerApp::save( "test_counters", false );
+    auto timers2 = ProfilerApp::load( "test_counters", getRank(), false ).timers;
+    bool pass    = timers.size() == 1 && timers2.size() == 1;
+    if ( pass ) {
+        const auto &trace  = timers[0].trace[0];
+        const auto &trace2 = timers2[0].trace[0];
+        pass = trace.N == 10 && trace.perf_set == set && trace.perf[0] > 0;
+        pass = pass && trace2.perf_set == set && trace2.perf[0] == trace.perf[0];
+    }
+    if ( !pass ) {
+        std::cout << "Error with the performance counters\n";
+        N_errors++;
+    }
+    PROFILE_DISABLE();
+    return N_errors;
+}
+
+
+// Check that we can read consistent results while another thread is running timers
+int test_live_results()
+{
+    int N_errors = 0;
+    PROFILE_ENABLE();
+    std::atomic_bool finished( false );
+    std::thread worker( [&finished] {
+        while ( !finished ) {
+            PROFILE( "live (outer)" );
+            PROFILE( "live (inner)" );
+        }
+    } );
+    uint64_t N_last = 0;
+    auto t0         = std::chrono::steady_clock::now();
+    for ( int i = 0; i < 200 || N_last < 10000; i++ ) {
+        if ( std::chrono::steady_clock::now() - t0 > std::chrono::seconds( 5 ) )
+            break;
+        for ( const auto &timer : ProfilerApp::getTimerResults() ) {
+            for ( const auto &trace : timer.trace ) {
+                bool pass = trace.N_timed <= trace.N && trace.min <= trace.max &&
+                            trace.self <= trace.tot && trace.N_desc >= trace.N_child;
+                if ( strcmp( timer.message, "live (outer)" ) == 0 ) {
+                    // Each call has exactly one child (the running call may not have finished it)
+                    pass = pass && trace.N_child <= trace.N && trace.N_child + 1 >= trace.N;
+                    pass = pass && trace.N >= N_last;
+                    N_last = trace.N;
+                }
+                if ( !pass ) {
+                    std::cout << "Inconsistent live results for " << timer.message << std::endl;
+                    N_errors++;
+                }
+            }
+        }
+    }
+    finished = true;
+    worker.join();
+    if ( N_last == 0 ) {
+        std::cout << "Live results did not include the running thread\n";
+        N_errors++;
+    }
+    PROFILE_DISABLE();
+    return N_errors;
+}
+
+
+// Check that we can copy the trace data while another thread is recycling the ring buffer
+int test_live_trace()
+{
+    int N_errors = 0;
+    PROFILE_ENABLE();
+    PROFILE_ENABLE_TRACE();
+    ProfilerApp::setTraceWindow( 500 );
+    std::atomic_bool finished( false );
+    std::thread worker( [&finished] {
+        while ( !finished ) {
+            PROFILE( "live trace" );
+        }
+    } );
+    size_t N_read = 0;
+    auto t0       = std::chrono::steady_clock::now();
+    for ( int i = 0; i < 200 || N_read == 0; i++ ) {
+        if ( std::chrono::steady_clock::now() - t0 > std::chrono::seconds( 5 ) )
+            break;
+        for ( const auto &timer : ProfilerApp::getTimerResults() ) {
+            for ( const auto &trace : timer.trace ) {
+                if ( trace.N_trace == 0 )
+                    continue;
+                std::vector<uint64_t> start( trace.N_trace ), stop( trace.N_trace );
+                trace.getTimes( start.data(), stop.data() );
+                bool pass = trace.N_trace <= 501 && start[0] <= stop[0];
+                for ( size_t j = 1; j < trace.N_trace; j++ )
+                    pass = pass && start[j] >= stop[j - 1] && stop[j] >= start[j];
+                if ( !pass ) {
+                    std::cout << "Inconsistent live trace data for " << timer.message << std::endl;
+                    N_errors++;
+                }
+                N_read++;
+            }
+        }
+    }
+    finished = true;
+    worker.join();
+    if ( N_read == 0 ) {
+        std::cout << "Live results did not include the trace data\n";
+        N_errors++;
+    }
+    ProfilerApp::setTraceWindow( 0 );
+    PROFILE_DISABLE_TRACE();
+    PROFILE_DISABLE();
+    return N_errors;
+}
+
+
+// Check that the trace ring buffer keeps the most recent calls
+int test_trace_window()
+{
+    int N_errors = 0;
+    PROFILE_ENABLE();
+    PROFILE_ENABLE_TRACE();
+    ProfilerApp::setTraceWindow( 100 );
+    auto t0 = std::chrono::steady_clock::now();
+    for ( int i = 0; i < 1000; i++ ) {
+        PROFILE( "ring" );
+        std::this_thread::sleep_for( std::chrono::microseconds( 50 ) );
+    }
+    double elapsed = 1e-9 * std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                std::chrono::steady_clock::now() - t0 )
+                                .count();
+    ProfilerApp::setTraceWindow( 0 );
+    PROFILE_DISABLE_TRACE();
+    auto timers = ProfilerApp::getTimerResults();
+    auto &trace = timers[0].trace[0];
+    // Decode the times (the last 100 calls should take ~1/10 of the time)
+    bool pass = trace.N == 1000 && trace.N_trace == 100;
+    if ( pass ) {
+        std::vector<uint64_t> start( trace.N_trace ), stop( trace.N_trace );
+        trace.getTimes( start.data(), stop.data() );
+        double span = 1e-9 * ( stop.back() - start.front() );
+        double end  = 1e-9 * stop.back();
+        pass = span < 0.5 * elapsed && span > 0.05 * elapsed && end > 0.9 * elapsed &&
+               end < elapsed + 1;
+    }
+    if ( !pass ) {
+        std::cout << "Error with trace ring buffer\n";
+        N_errors++;
+    }
+    PROFILE_DISABLE();
+    return N_errors;
+}
+
+
+// Check the detailed trace data that spans many storage blocks (with and without the ring buffer)
+int test_trace_blocks()
+{
+    int N_errors = 0;
+    PROFILE_ENABLE();
+    PROFILE_ENABLE_TRACE();
+    const uint32_t N = 100000;
+    for ( uint32_t i = 0; i < N; i++ ) {
+        PROFILE( "blocks" );
+    }
+    ProfilerApp::setTraceWindow( 5000 );
+    for ( uint32_t i = 0; i < N; i++ ) {
+        PROFILE( "blocks (ring)" );
+    }
+    ProfilerApp::setTraceWindow( 0 );
+    PROFILE_DISABLE_TRACE();
+    auto timers = ProfilerApp::getTimerResults();
+    for ( const auto &timer : timers ) {
+        auto &trace       = timer.trace[0];
+        uint32_t N_expect = strcmp( timer.message, "blocks" ) == 0 ? N : 5000;
+        bool pass         = trace.N == N && trace.N_trace == N_expect;
+        if ( pass ) {
+            std::vector<uint64_t> start( trace.N_trace ), stop( trace.N_trace );
+            trace.getTimes( start.data(), stop.data() );
+            for ( size_t i = 0; i < trace.N_trace; i++ )
+                pass = pass && start[i] <= stop[i] && ( i == 0 || stop[i - 1] <= start[i] );
+            // Check the time range and a ranged decode against the full decode
+            auto range = trace.getTimeRange();
+            pass       = pass && range[0] == start.front() && range[1] == stop.back();
+            auto index = trace.indexTimes( 1000 );
+            size_t i0 = N_expect / 3, i1 = 2 * N_expect / 3;
+            std::vector<uint64_t> start2, stop2;
+            trace.getTimes( index, start[i0], stop[i1], start2, stop2 );
+            auto first    = std::lower_bound( stop.begin(), stop.end(), start[i0] );
+            auto last     = std::upper_bound( start.begin(), start.end(), stop[i1] );
+            size_t offset = first - stop.begin();
+            size_t end    = last - start.begin();
+            pass          = pass && start2.size() == end - offset && offset <= i0 && end > i1;
+            for ( size_t i = 0; pass && i < start2.size(); i++ )
+                pass = start2[i] == start[offset + i] && stop2[i] == stop[offset + i];
+        }
+        if ( !pass ) {
+            std::cout << "Error with trace blocks: " << timer.message << std::endl;
+            N_errors++;
+        }
+    }
+    PROFILE_DISABLE();
+    return N_errors;
+}
+
+
+// Check the periodic snapshots from the background thread
+int test_autosave()
+{
+    int N_errors  = 0;
+    auto filename = []( int seq ) {
+        return "test_autosave." + std::to_string( seq ) + "." + std::to_string( getRank() + 1 ) +
+               ".timer";
+    };
+    for ( int seq = 1; seq <= 100; seq++ )
+        std::remove( filename( seq ).data() );
+    PROFILE_ENABLE();
+    ProfilerApp::setAutoSave( "test_autosave", 0.02, 2 );
+    auto t0 = std::chrono::steady_clock::now();
+    while ( std::chrono::steady_clock::now() - t0 < std::chrono::milliseconds( 200 ) ) {
+        PROFILE( "autosave" );
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+    }
+    ProfilerApp::setAutoSave( "", 0 );
+    // Only the last two snapshots should remain
+    std::vector<int> snapshots;
+    for ( int seq = 1; seq <= 100; seq++ ) {
+        if ( FILE *fid = fopen( filename( seq ).data(), "rb" ) ) {
+            fclose( fid );
+            snapshots.push_back( seq );
+        }
+    }
+    if ( snapshots.size() != 2 || snapshots[0] < 2 || snapshots[1] != snapshots[0] + 1 ) {
+        std::cout << "Error with autosave snapshots\n";
+        N_errors++;
+    } else {
+        auto name = "test_autosave." + std::to_string( snapshots[1] );
+        auto data = ProfilerApp::load( name, getRank(), false );
+        if ( data.timers.size() != 1 || data.timers[0].trace[0].N == 0 ) {
+            std::cout << "Error loading autosave snapshot\n";
+            N_errors++;
+        }
+    }
+    PROFILE_DISABLE();
+    return N_errors;
+}
+
+
+// Check filtering the calls stored in the trace data by duration and rate
+int test_trace_filter()
+{
+    int N_errors = 0;
+    PROFILE_ENABLE();
+    PROFILE_ENABLE_TRACE();
+    ProfilerApp::setTraceFilter( 100e-6 );
+    for ( int i = 0; i < 1000; i++ ) {
+        PROFILE( "filter (duration)" );
+        if ( i % 10 == 0 )
+            std::this_thread::sleep_for( std::chrono::microseconds( 200 ) );
+    }
+    ProfilerApp::setTraceFilter( 0, 1000 );
+    for ( int i = 0; i < 20000; i++ ) {
+        PROFILE( "filter (rate)" );
+    }
+    ProfilerApp::setTraceFilter( 0 );
+    PROFILE_DISABLE_TRACE();
+    auto timers = ProfilerApp::getTimerResults();
+    for ( const auto &timer : timers ) {
+        auto &trace = timer.trace[0];
+        std::vector<uint64_t> start( trace.N_trace ), stop( trace.N_trace );
+        trace.getTimes( start.data(), stop.data() );
+        bool pass = trace.N_trace > 0;
+        if ( strcmp( timer.message, "filter (duration)" ) == 0 ) {
+            pass = pass && trace.N == 1000 && trace.N_trace == 100;
+            for ( size_t i = 0; i < trace.N_trace; i++ )
+                pass = pass && stop[i] - start[i] >= 100000;
+        } else {
+            pass = pass && trace.N == 20000 && trace.N_trace < trace.N;
+            for ( size_t i = 1; i < trace.N_trace; i++ )
+                pass = pass && start[i] >= stop[i - 1] + 1000000;
+        }
+        if ( !pass ) {
+            std::cout << "Error with trace filter: " << timer.message << std::endl;
+            N_errors++;
+        }
+    }
+    PROFILE_DISABLE();
+    return N_errors;
+}
+
+
+// Check streaming the trace data to disk (more calls than can be stored in memory)
+int test_trace_stream()
+{
+    int N_errors = 0;
+    PROFILE_ENABLE();
+    PROFILE_ENABLE_TRACE();
+    ProfilerApp::setTraceStream( "test_stream" );
+    auto call = []( bool after ) {
+        PROFILE( "stream" );
+        if ( after ) {
+            PROFILE( "stream (after save)" );
+        }
+    };
+    const uint32_t N = 1200000;
+    for ( uint32_t i = 0; i < N; i++ )
+        call( false );
+    ProfilerApp::save( "test_stream", false );
+    // The calls streamed after the save must not be loaded with it
+    const uint32_t N2 = 100000;
+    for ( uint32_t i = 0; i < N2; i++ )
+        call( true );
+    ProfilerApp::save( "test_stream2", false );
+    PROFILE_DISABLE_TRACE();
+    auto check = []( const char *filename, size_t N_timers, uint64_t N ) {
+        auto data  = ProfilerApp::load( filename, getRank(), false );
+        bool pass  = data.timers.size() == N_timers;
+        auto trace = pass ? &data.timers[0].trace[0] : nullptr;
+        for ( auto &timer : data.timers ) {
+            if ( strcmp( timer.message, "stream" ) == 0 )
+                trace = &timer.trace[0];
+        }
+        pass = pass && trace->N == N && trace->N_trace == N;
+        if ( pass ) {
+            std::vector<uint64_t> start( N ), stop( N );
+            trace->getTimes( start.data(), stop.data() );
+            for ( size_t i = 0; i < N; i++ )
+                pass = pass && start[i] <= stop[i] && ( i == 0 || stop[i - 1] <= start[i] );
+        }
+        if ( !pass )
+            std::cout << "Error with trace stream: " << filename << std::endl;
+        return pass ? 0 : 1;
+    };
+    N_errors += check( "test_stream", 1, N );
+    N_errors += check( "test_stream2", 2, N + N2 );
+    PROFILE_DISABLE();
+    return N_errors;
+}
+
+
+// Check that the binary timer format loads the same results that were saved
+int test_save_binary()
+{
+    int N_errors = 0;
+    PROFILE_ENABLE();
+    ProfilerApp::setStoreHistogram( true );
+    ProfilerApp::setStoreSlowest( true );
+    for ( int i = 0; i < 100; i++ ) {
+        PROFILE( "binary" );
+        PROFILE( "binary (child)" );
+    }
+    ProfilerApp::setStoreHistogram( false );
+    ProfilerApp::setStoreSlowest( false );
+    auto data1 = ProfilerApp::getTimerResults();
+    ProfilerApp::setSaveBinary( true );
+    ProfilerApp::save( "test_binary", false );
+    ProfilerApp::setSaveBinary( false );
+    auto data2 = ProfilerApp::load( "test_binary", getRank(), false ).timers;
+    sort( data1 );
+    sort( data2 );
+    bool pass = data1.size() == 2 && data1.size() == data2.size();
+    for ( size_t i = 0; pass && i < data1.size(); i++ )
+        pass = data1[i] == data2[i] && data2[i].trace[0].hist && data2[i].trace[0].slow;
+    if ( !pass ) {
+        std::cout << "Error with binary timer format\n";
+        N_errors++;
+    }
+    PROFILE_DISABLE();
+    return N_errors;
+}
+
+
 // Run all tests
 int run_tests( bool enable_trace, bool enable_memory, std::string save_name )
 {
@@ -443,6 +1041,27 @@ int run_tests( bool enable_trace, bool enable_memory, std::string save_name )
     ProfilerApp::stop( id );
     sort( data2 );
 
+    // Load the data with the trace data mapped from the file and check the times
+    auto data3 = ProfilerApp::load( save_name, rank, true, true ).timers;
+    sort( data3 );
+    bool lazy = data2.size() == data3.size();
+    for ( size_t i = 0; lazy && i < data2.size(); i++ ) {
+        for ( size_t j = 0; lazy && j < data2[i].trace.size(); j++ ) {
+            auto &trace2 = data2[i].trace[j];
+            auto &trace3 = data3[i].trace[j];
+            lazy         = trace2 == trace3 && ( trace3.file != nullptr ) == ( trace3.N_trace > 0 );
+            std::vector<uint64_t> start2( trace2.N_trace ), stop2( trace2.N_trace );
+            std::vector<uint64_t> start3( trace3.N_trace ), stop3( trace3.N_trace );
+            trace2.getTimes( start2.data(), stop2.data() );
+            trace3.getTimes( start3.data(), stop3.data() );
+            lazy = lazy && start2 == start3 && stop2 == stop3;
+        }
+    }
+    if ( !lazy ) {
+        std::cout << "Trace data does not match when mapped from the file\n";
+        N_errors++;
+    }
+
     // Find and check sleep
     TraceResults *trace = nullptr;
     for ( auto &timer : data1 ) {
@@ -453,6 +1072,32 @@ int run_tests( bool enable_trace, bool enable_memory, std::string save_name )
                 std::cout << "Error profiling sleep: " << tot << std::endl;
                 N_errors++;
             }
+            if ( trace->self != trace->tot ) {
+                std::cout << "Error with exclusive time for sleep: " << trace->self << std::endl;
+                N_errors++;
+            }
+            if ( trace->perf_set != 0 && trace->perf[0] == 0 ) {
+                std::cout << "Error with performance counters for sleep\n";
+                N_errors++;
+            }
+            bool cpu = ProfilerApp::getStoreCPU();
+            if ( cpu && ( trace->cpu < 0 || trace->cpu > 0.1 * trace->tot ) ) {
+                std::cout << "Error with CPU time for sleep: " << trace->cpu << std::endl;
+                N_errors++;
+            }
+        }
+        if ( strcmp( timer.message, "MAIN" ) == 0 ) {
+            auto &main = timer.trace[0];
+            if ( main.self < 0 || main.self > main.tot - 1e9 ) {
+                std::cout << "Error with exclusive time for MAIN: " << main.self << std::endl;
+                N_errors++;
+            }
+            if ( main.overhead <= 0 || main.N_child == 0 || main.N_desc < main.N_child ||
+                 main.totCorrected() > main.tot || main.selfCorrected() > main.self ) {
+                std::cout << "Error with overhead correction for MAIN: " << main.overhead << " "
+                          << main.N_child << " " << main.N_desc << std::endl;
+                N_errors++;
+            }
         }
     }
     if ( trace == nullptr ) {
@@ -540,6 +1185,44 @@ int main( int argc, char *argv[] )
         printf( "\n" );
     }
 
+    // Check the performance counters
+    ProfilerApp::setStoreCounters( true );
+    const char *counters[] = { "not available", "hardware", "software" };
+    if ( rank == 0 )
+        printf( "Performance counters: %s\n", counters[(int) ProfilerApp::getStoreCounters()] );
+    ProfilerApp::setStoreCounters( false );
+
+    // Test the clock source
+    N_errors += test_clock_source();
+
+    // Test the maximum timer level
+    N_errors += test_max_level();
+
+    // Test throttling hot timers
+    N_errors += test_throttle();
+
+    // Test the histogram of the call times
+    N_errors += test_histogram();
+    N_errors += test_slowest();
+
+    // Test the CPU time and performance counters of the calls
+    N_errors += test_cpu_time();
+    N_errors += test_counters();
+
+    // Test reading the results while another thread is running
+    N_errors += test_live_results();
+    N_errors += test_live_trace();
+
+    // Test the trace ring buffer
+    N_errors += test_trace_window();
+    N_errors += test_trace_blocks();
+    N_errors += test_trace_filter();
+
+    // Test saving periodic snapshots
+    N_errors += test_autosave();
+    N_errors += test_trace_stream();
+    N_errors += test_save_binary();
+
     // Run the profiler tests
     {
         std::vector<std::tuple<bool, bool, std::string>> tests;
@@ -47,6 +47,18 @@ bool load_test( const std::string& name, size_t size, bool includes_trace, bool
             std::cout << "Error with memory data\n";
     }
 
+    // Check that the ranks loaded in parallel match a sequential load
+    // (one thread loads each file directly into the results, as before the parallel load)
+    ProfilerApp::setLoadThreads( 1 );
+    auto load_results1 = ProfilerApp::load( name, -1, false );
+    ProfilerApp::setLoadThreads( 4 );
+    auto load_results2 = ProfilerApp::load( name, -1, false );
+    ProfilerApp::setLoadThreads( 0 );
+    if ( load_results1 != load_results2 ) {
+        std::cout << "Parallel load does not match sequential load\n";
+        pass = false;
+    }
+
     return pass;
 }
 